@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+// A valid Ling program of at least size bytes, shaped like our generated sources
+inline std::string generateSource(std::size_t size)
+{
+    std::string source;
+    source.reserve(size + 256);
+    for(unsigned i = 0; source.size() < size; ++i)
+    {
+        auto name = "counter_" + std::to_string(i);
+        source += "let " + name + " = " + std::to_string(i * 7919 % 100000) + ";\n";
+        source += "while(" + name + " > 1) {\n";
+        source += "    " + name + " = " + name + " / 2;\n";
+        source += "    display " + name + ";\n";
+        source += "}\n\n";
+    }
+    return source;
+}
@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+# Compares the interpreter (ling -r) against the native path (ling + running the executable)
+# on every program in tests/. Times are end-to-end, summed over REPEAT runs.
+#
+# Usage: bench/interpreter.sh [path/to/ling] [REPEAT]
+
+set -euo pipefail
+
+LING="$(realpath "${1:-build/ling}")"
+REPEAT="${2:-20}"
+TESTS="$(dirname "$0")/../tests"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+now() { date +%s%N; }
+
+printf "%-12s %16s %16s %16s\n" "program" "interpreter [ms]" "native [ms]" "compile [ms]"
+
+for source in "$TESTS"/*.ling; do
+    name="$(basename "$source" .ling)"
+    cp "$source" "$WORK/"
+
+    start=$(now)
+    for ((i = 0; i < REPEAT; ++i)); do (cd "$WORK" && "$LING" "$name" -r > /dev/null); done
+    interpreted=$(( ($(now) - start) / 1000000 ))
+
+    native="-"
+    compiled="-"
+    if command -v nasm > /dev/null; then
+        start=$(now)
+        for ((i = 0; i < REPEAT; ++i)); do (cd "$WORK" && "$LING" "$name"); done
+        compiled=$(( ($(now) - start) / 1000000 ))
+
+        start=$(now)
+        for ((i = 0; i < REPEAT; ++i)); do "$WORK/$name" > /dev/null; done
+        native=$(( compiled + ($(now) - start) / 1000000 ))
+    fi
+
+    printf "%-12s %16s %16s %16s\n" "$name" "$interpreted" "$native" "$compiled"
+done
@@ -0,0 +1,119 @@
+/**
+ *  Throughput of the tokenizer's character class kernels, in bytes per cycle of the time stamp
+ *  counter. Every level the CPU supports is checked against the scalar one before it is timed.
+ *
+ *  Build with: cmake --build build --target lexer-bench
+ *  Usage: build/lexer-bench [program.ling] [REPEAT]
+ *  Without a program, a few megabytes of generated statements are scanned.
+ */
+#include "../src/frontend/Scanner.hpp"
+#include "../src/frontend/Tokens.hpp"
+#include "GeneratedSource.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+static uint64_t readCycles() { return __rdtsc(); }
+#else
+// without a time stamp counter nanoseconds stand in for cycles
+static uint64_t readCycles() { return std::chrono::steady_clock::now().time_since_epoch().count(); }
+#endif
+
+// Walks the source the way Tokenization::tokenize does, without building tokens
+static uint64_t scan(const Scanner::Kernels& kernels, const std::string& source)
+{
+    uint64_t checksum = 0;
+    const char* end = source.data() + source.size();
+    Scanner::Cursor cursor(end, kernels);
+    for(const char* it = source.data(); (it = cursor.skipWhitespace(it)) != end;)
+    {
+        const char* tokenEnd;
+        if(std::isdigit(*it)) tokenEnd = cursor.skipDigits(it);
+        else if(std::isalpha(*it)) tokenEnd = cursor.skipIdentifier(it);
+        else tokenEnd = it + 1;
+
+        checksum = checksum * 31 + (tokenEnd - source.data());
+        it = tokenEnd;
+    }
+    return checksum;
+}
+
+template<class Function>
+static double bytesPerCycle(std::size_t bytes, unsigned repeat, Function function)
+{
+    uint64_t best = UINT64_MAX;
+    for(unsigned i = 0; i < repeat; ++i)
+    {
+        auto start = readCycles();
+        function();
+        best = std::min(best, readCycles() - start);
+    }
+    return static_cast<double>(bytes) / std::max<uint64_t>(best, 1);
+}
+
+int main(int argc, char** argv)
+{
+    std::string source;
+    if(argc > 1)
+    {
+        std::ifstream file(argv[1], std::ios::binary);
+        if(!file)
+        {
+            std::cerr << "Cannot read " << argv[1] << "\n";
+            return 1;
+        }
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        source = std::move(contents).str();
+    }
+    else source = generateSource(8 << 20);
+    unsigned repeat = argc > 2 ? std::stoul(argv[2]) : 10;
+
+    auto& scalar = Scanner::getKernels(Scanner::Level::Scalar);
+    auto expectedScan = scan(scalar, source);
+    auto expectedNewLines = scalar.countNewLines(source.data(), source.data() + source.size());
+
+    std::printf("%zu bytes, best of %u runs, bytes per TSC cycle\n", source.size(), repeat);
+    std::printf("%-8s %12s %12s\n", "level", "scan", "newlines");
+
+    for(auto level : {Scanner::Level::Scalar, Scanner::Level::SSE2, Scanner::Level::AVX2})
+    {
+        if(level > Scanner::getSupportedLevel()) continue;
+        auto& kernels = Scanner::getKernels(level);
+
+        if(scan(kernels, source) != expectedScan || kernels.countNewLines(source.data(), source.data() + source.size()) != expectedNewLines)
+        {
+            std::cerr << Scanner::getLevelName(level) << " kernels disagree with the scalar ones\n";
+            return 1;
+        }
+
+        volatile uint64_t sink;
+        auto scanSpeed = bytesPerCycle(source.size(), repeat, [&] { sink = scan(kernels, source); });
+        auto newLinesSpeed = bytesPerCycle(source.size(), repeat, [&] { sink = kernels.countNewLines(source.data(), source.data() + source.size()); });
+        std::printf("%-8s %12.3f %12.3f\n", Scanner::getLevelName(level), scanSpeed, newLinesSpeed);
+    }
+
+    Tokenization::Source registered(source);
+    std::size_t tokens = 0;
+    try
+    {
+        auto tokenizeSpeed = bytesPerCycle(source.size(), repeat, [&] { tokens = Tokenization::tokenize(registered).size(); });
+        std::printf("tokenize (%s, %zu tokens) %.3f\n", Scanner::getLevelName(Scanner::getSupportedLevel()), tokens, tokenizeSpeed);
+    }
+    catch(std::exception& e)
+    {
+        std::fflush(stdout);
+        std::cerr << "tokenize failed:\n" << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
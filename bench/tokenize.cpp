@@ -0,0 +1,63 @@
+/**
+ *  Scaling of the parallel tokenizer from 1 to N threads on a generated program, checked against
+ *  the sequential tokenizer.
+ *
+ *  Build with: cmake --build build --target tokenize-bench
+ *  Usage: build/tokenize-bench [MEGABYTES] [THREADS] [REPEAT]
+ *  Defaults to 128 MB and every hardware thread.
+ */
+#include "../src/frontend/Tokens.hpp"
+#include "GeneratedSource.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static bool sameTokens(const std::vector<Tokenization::Token>& a, const std::vector<Tokenization::Token>& b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Tokenization::Token& x, const Tokenization::Token& y) {
+        return x.offset == y.offset && x.length == y.length && x.symbol == y.symbol && x.type == y.type;
+    });
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 128;
+    unsigned maxThreads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+    unsigned repeat = argc > 3 ? std::stoul(argv[3]) : 3;
+
+    auto text = generateSource(megabytes << 20);
+    Tokenization::Source source(text);
+    auto expected = Tokenization::tokenize(source);
+
+    std::printf("%zu bytes, %zu tokens, best of %u runs\n", text.size(), expected.size(), repeat);
+    std::printf("%8s %10s %10s %8s\n", "threads", "ms", "MB/s", "speedup");
+
+    std::vector<unsigned> counts;
+    for(unsigned threads = 1; threads < maxThreads; threads *= 2) counts.push_back(threads);
+    counts.push_back(maxThreads);
+
+    double sequential = 0;
+    for(auto threads : counts)
+    {
+        double best = 1e300;
+        for(unsigned i = 0; i < repeat; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto tokens = Tokenization::tokenizeParallel(source, threads);
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+            if(!sameTokens(tokens, expected))
+            {
+                std::cerr << "Tokens on " << threads << " threads differ from the sequential ones\n";
+                return 1;
+            }
+        }
+        if(threads == 1) sequential = best;
+        std::printf("%8u %10.1f %10.1f %8.2f\n", threads, best, text.size() / best / 1e3, sequential / best);
+    }
+    return 0;
+}
@@ -1,534 +1,682 @@
 #include "CodeGen.hpp"
+#include "Toolchain.hpp"
+#include <array>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
+#include <iostream>
+#include <mutex>
 #include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <unistd.h>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
 
 const char* displayFunctionAssembly = R"(default rel
 
+%define OUTPUT_CAPACITY 65536
+%define MAX_LINE_LENGTH 21
+
 section .bss
-    __display__buffer__     resb    32
+    __output__buffer__      resb    OUTPUT_CAPACITY
+    __output__length__      resq    1
+
+section .data
+    __output__line_buffered__   db  0
+
+section .rodata
+    __digit__pairs__        db "00010203040506070809"
+                            db "10111213141516171819"
+                            db "20212223242526272829"
+                            db "30313233343536373839"
+                            db "40414243444546474849"
+                            db "50515253545556575859"
+                            db "60616263646566676869"
+                            db "70717273747576777879"
+                            db "80818283848586878889"
+                            db "90919293949596979899"
+    __powers__of__ten__     dq 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+                            dq 10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000
+                            dq 1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000
+                            dq 0x8AC7230489E80000
 
 section .text
     global __display__function__
+    global __output__flush__
+    global __output__line_buffered__
+
+; Runtime helpers use a preserve-most convention: the argument is passed in rdi and every
+; general purpose register, the argument included, is preserved. Only flags are clobbered,
+; so callers never have to spill registers around a helper call.
 
+; Formats rdi as a decimal line straight into the output buffer. The digit count is
+; computed up front so the number is written in place, two digits at a time, using
+; a multiplication by the reciprocal of 100 instead of a division.
 __display__function__:
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push r8
+    push r9
+
+    mov rdx, [__output__length__]
+    cmp rdx, OUTPUT_CAPACITY - MAX_LINE_LENGTH
+    jbe .format
+    call __output__flush__
+    xor rdx, rdx
+
+.format:
+    lea rsi, [__output__buffer__]
+    add rsi, rdx
     mov rax, rdi
-    lea rsi, [__display__buffer__ + 31]
+    test rax, rax
+    jns .count
+    mov byte [rsi], '-'
+    inc rsi
+    neg rax                         ; INT64_MIN stays 2^63, which is correct as unsigned
+
+.count:
+    ; digits = t + 1 - (m < 10^t), where m = n | 1 and t = (bsr(m) + 1) * 1233 >> 12
+    mov rdx, rax
+    or rdx, 1
+    bsr rcx, rdx
+    inc ecx
+    imul ecx, ecx, 1233
+    shr ecx, 12
+    lea r8, [__powers__of__ten__]
+    cmp rdx, [r8 + rcx*8]
+    sbb rcx, -1
+
+    add rsi, rcx
     mov byte [rsi], 10
-    mov rcx, 1
+    lea rdx, [rsi + 1]
+    lea r8, [__output__buffer__]
+    sub rdx, r8
+    mov [__output__length__], rdx
+
+    lea r8, [__digit__pairs__]
+    mov r9, 0x28F5C28F5C28F5C3      ; n / 100 == ((n >> 2) * r9) >> 66
+
+.pairs:
+    cmp rax, 100
+    jb .last
+    mov rcx, rax
+    shr rax, 2
+    mul r9
+    shr rdx, 2
+    imul rax, rdx, 100
+    sub rcx, rax
+    movzx ecx, word [r8 + rcx*2]
+    sub rsi, 2
+    mov [rsi], cx
+    mov rax, rdx
+    jmp .pairs
+
+.last:
+    cmp rax, 10
+    jb .single
+    movzx ecx, word [r8 + rax*2]
+    mov [rsi - 2], cx
+    jmp .written
+
+.single:
+    add al, '0'
+    mov [rsi - 1], al
+
+.written:
+    cmp byte [__output__line_buffered__], 0
+    je .restore
+    call __output__flush__
+
+.restore:
+    pop r9
+    pop r8
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    ret
+
+__output__flush__:
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r11
+
+    lea rsi, [__output__buffer__]
+    mov rdx, [__output__length__]
 
+.write:
+    test rdx, rdx
+    jz .flushed
+    mov rax, 1
+    mov rdi, 1
+    syscall
     test rax, rax
-    jns .positive
+    jle .flushed
+    add rsi, rax
+    sub rdx, rax
+    jmp .write
+
+.flushed:
+    mov qword [__output__length__], 0
+    pop r11
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    ret)";
 
-    neg rax
-    mov r8b, '-'
-    jmp .convert
+struct RuntimeHelper {
+    std::string_view symbol;
+    std::string_view argumentRegister;
+    std::vector<std::string_view> clobberedRegisters;
+};
+
+// Both helpers follow the preserve-most convention described in the runtime assembly
+inline static const RuntimeHelper displayHelper = {"__display__function__", "rdi", {}};
+inline static const RuntimeHelper flushHelper = {"__output__flush__", "", {}};
 
-.positive:
-    xor r8b, r8b
+// Registers InstructionGenerator never uses as scratch, available for holding variables
+inline static const std::vector<std::string_view> allocatableRegisters = {
+    "rcx", "rsi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
 
-.convert:
-    cmp rax, 0
-    jne .convert_loop
+/**
+ *  Assigns registers to the most used variables for the whole program. Ling has no functions,
+ *  so the only calls are runtime helpers: a register stays allocatable unless a helper called
+ *  by the program clobbers it or takes its argument in it.
+ */
+static std::unordered_map<unsigned, std::string_view> allocateVariableRegisters(const BuilderIR& builderIR, const std::vector<const RuntimeHelper*>& helpers)
+{
+    std::unordered_map<unsigned, unsigned> uses;
+    for(std::size_t i = 0; i < builderIR.size(); ++i)
+    {
+        auto kind = builderIR.getOpcode(i).kind;
+        if(kind == BuilderIR::Kind::Load) ++uses[builderIR.getWords(i)[1]];
+        if(kind == BuilderIR::Kind::Store) ++uses[builderIR.getWords(i)[0]];
+    }
 
-    dec rsi
-    mov byte [rsi], '0'
-    inc rcx
-    jmp .sign
+    std::vector<std::string_view> registers;
+    for(auto reg : allocatableRegisters)
+    {
+        bool available = true;
+        for(auto* helper : helpers)
+        {
+            if(helper->argumentRegister == reg) available = false;
+            for(auto clobbered : helper->clobberedRegisters)
+                if(clobbered == reg) available = false;
+        }
+        if(available) registers.push_back(reg);
+    }
 
-.convert_loop:
-    mov r9, 10
-.loop_div:
-    xor rdx, rdx
-    div r9
-    add dl, '0'
-    dec rsi
-    mov [rsi], dl
-    inc rcx
-    test rax, rax
-    jnz .loop_div
+    std::vector<std::pair<unsigned, unsigned>> variables(uses.begin(), uses.end());
+    std::sort(variables.begin(), variables.end(), [](auto& a, auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
 
-.sign:
-    test r8b, r8b
-    jz .write
-    dec rsi
-    mov [rsi], r8b
-    inc rcx
+    std::unordered_map<unsigned, std::string_view> allocation;
+    for(std::size_t i = 0; i < variables.size() && i < registers.size(); ++i)
+        allocation.emplace(variables[i].first, registers[i]);
 
-.write:
-    mov rax, 1
-    mov rdi, 1
-    mov rdx, rcx
-    syscall
-    ret)";
+    return allocation;
+}
+
+/**
+ *  The assembly text is formatted straight into one preallocated buffer, so emitting an instruction
+ *  allocates nothing. Integers are formatted by hand two digits at a time instead of going through
+ *  a stream. Given a file, a full buffer is written out in one call and reused; otherwise the
+ *  buffer grows by doubling and ends up holding the whole program.
+ */
+class AssemblyBuffer {
+public:
+    explicit AssemblyBuffer(std::size_t capacity, Toolchain::OutputFile* file = nullptr) : text(capacity, '\0'), file(file) {}
+
+    AssemblyBuffer& operator<<(std::string_view string)
+    {
+        char* out = reserve(string.size());
+        std::memcpy(out, string.data(), string.size());
+        length += string.size();
+        return *this;
+    }
+
+    AssemblyBuffer& operator<<(unsigned value) { return append(value, false); }
+    AssemblyBuffer& operator<<(int value) { return append(value < 0 ? 0u - static_cast<unsigned>(value) : value, value < 0); }
+
+    std::string take() &&
+    {
+        text.resize(length);
+        return std::move(text);
+    }
+
+    void flush()
+    {
+        if(file) file->write({text.data(), length});
+        length = 0;
+    }
+
+private:
+    // "00" to "99", the two digits of every value below 100
+    static constexpr auto digitPairs = [] {
+        std::array<char, 200> pairs{};
+        for(int i = 0; i < 100; ++i)
+        {
+            pairs[2 * i] = static_cast<char>('0' + i / 10);
+            pairs[2 * i + 1] = static_cast<char>('0' + i % 10);
+        }
+        return pairs;
+    }();
+
+    char* reserve(std::size_t size)
+    {
+        if(text.size() - length < size)
+        {
+            if(file) flush();
+            if(text.size() - length < size) text.resize(std::max(2 * text.size(), length + size));
+        }
+        return text.data() + length;
+    }
+
+    AssemblyBuffer& append(unsigned magnitude, bool negative)
+    {
+        // the digits are written backwards from the end of a scratch array, then copied out once
+        char digits[12];
+        char* first = std::end(digits);
+        while(magnitude >= 100)
+        {
+            first -= 2;
+            std::memcpy(first, &digitPairs[2 * (magnitude % 100)], 2);
+            magnitude /= 100;
+        }
+        if(magnitude >= 10)
+        {
+            first -= 2;
+            std::memcpy(first, &digitPairs[2 * magnitude], 2);
+        }
+        else *--first = static_cast<char>('0' + magnitude);
+        if(negative) *--first = '-';
+
+        return *this << std::string_view(first, std::end(digits) - first);
+    }
+
+    std::string text;
+    std::size_t length = 0;
+    Toolchain::OutputFile* file;
+};
+
+// Bytes of assembly reserved per instruction, enough that most programs never grow the buffer
+constexpr std::size_t expectedInstructionSize = 48;
+// Size of the writes to a .asm file
+constexpr std::size_t assemblyChunkSize = 1 << 20;
 
-struct InstructionGenerator {
-    InstructionGenerator(std::ostream& os, const BuilderIR& builderIR, const SymbolTable& symbolTable) 
-        : os(os), builderIR(builderIR), symbolTable(symbolTable), localVariablesOffset(symbolTable.getOffset() + 8) {}
-
-    void operator()(BuilderIR::InstructionLoad load) const;
-    void operator()(BuilderIR::InstructionStore store) const;
-    void operator()(BuilderIR::InstructionBinaryOperation binaryOperation) const;
-    void operator()(BuilderIR::InstructionUnaryOperator unaryOperation) const;
-    void operator()(BuilderIR::InstructionLabel label) const;
-    void operator()(BuilderIR::InstructionJump jump) const;
-    void operator()(BuilderIR::InstructionBranch branch) const;
-    void operator()(BuilderIR::InstructionDisplay display) const;
-    void operator()(BuilderIR::InstructionSet set) const;
-    void operator()(BuilderIR::InstructionCompareEqual cmpEqual) const;
-    void operator()(BuilderIR::InstructionCompareLess cmpLess) const;
-    void operator()(BuilderIR::InstructionCompareMore cmpMore) const;
-    void operator()(BuilderIR::InstructionBranchCmp branchCmp) const;
-
-    std::ostream& os;
+/**
+ *  Emits the assembly of one instruction at a time, reading the packed code of the BuilderIR
+ *  directly. Every operand, temporary and variable location is written piecewise into the buffer.
+ */
+class InstructionGenerator {
+public:
+    InstructionGenerator(AssemblyBuffer& out, const BuilderIR& builderIR, const SymbolTable& symbolTable, const std::unordered_map<unsigned, std::string_view>& allocation);
+
+    void generate(std::size_t index);
+
+private:
+    AssemblyBuffer& out;
     const BuilderIR& builderIR;
-    const SymbolTable& symbolTable;
     const unsigned localVariablesOffset;
 
-    unsigned getTempVarOffset(BuilderIR::TempVarID temp) const;
+    // register holding each variable indexed by offset / 8, empty for variables kept on the stack
+    std::vector<std::string_view> variableRegisters;
 
-    std::string getAddresFromOffset(unsigned offset) const;
-    std::string getTempVarAddress(BuilderIR::TempVarID temp) const;
+    std::string_view getRegister(unsigned variableOffset) const;
 
-    std::string convertAddressToValue(const std::string& address) const;
+    void writeTempVar(BuilderIR::TempVarID temp);
+    void writeLocalVar(unsigned variableOffset);
+    void writeOperand(BuilderIR::Word word);
+    void writeLabel(BuilderIR::LabelID label);
 
-    std::string generateMovImmediate(const std::string& to, int immediate) const;
-    std::string generateMovImmediateToTempVar(BuilderIR::TempVarID temp, int immediate) const;
-    std::string generateMovImmediateToLocalVar(unsigned variableOffset, int immediate) const;
-    std::string generateMovToTempVar(BuilderIR::TempVarID temp, const std::string& from) const;
-    std::string generateMovToLocalVar(unsigned variableOffset, const std::string& from) const;
-    std::string generateMovFromTempVar(const std::string& to, BuilderIR::TempVarID temp) const;
-    std::string generateMovFromLocalVar(const std::string& to, unsigned variableOffset) const;
+    // "\tmov to, operand\n", for the registers that load operands
+    void generateMovOperand(std::string_view to, BuilderIR::Word word);
+    void generateMovToTempVar(BuilderIR::TempVarID temp, std::string_view from);
+    void generateJumps(std::string_view jump, BuilderIR::LabelID ifTrue, BuilderIR::LabelID ifFalse);
 };
 
-inline static std::string generateMov(const std::string& to, const std::string& from)
+CodeGen::CodeGen(const BuilderIR &builderIR, const SymbolTable &symbolTable, bool lineBufferedOutput)
+    : builderIR(builderIR), symbolTable(symbolTable), lineBufferedOutput(lineBufferedOutput) {}
+
+std::string CodeGen::generateAssembly(const std::string &name)
 {
-    return "\tmov " + to + ", " + from + "\n";
+    Toolchain::OutputFile file(name + ".asm");
+    AssemblyBuffer code(assemblyChunkSize, &file);
+    emitAssembly(code);
+
+    code.flush();
+    file.close();
+    return name + ".asm";
 }
 
-CodeGen::CodeGen(const BuilderIR &builderIR, const SymbolTable &symbolTable)
-    : builderIR(builderIR), symbolTable(symbolTable) {}
+void CodeGen::writeAssembly(std::ostream &code)
+{
+    auto assembly = getAssembly();
+    code.write(assembly.data(), assembly.size());
+}
 
-std::string CodeGen::generateAssembly(const std::string &name)
+std::string CodeGen::getAssembly()
 {
-    std::ofstream code(name + ".asm");
+    AssemblyBuffer code(builderIR.size() * expectedInstructionSize + 1024);
+    emitAssembly(code);
+    return std::move(code).take();
+}
 
+void CodeGen::emitAssembly(AssemblyBuffer &code)
+{
     // set default mode to relative
     code << "default rel\n";
 
     // add .text section
     code << "section .text\n"
             "\tglobal _start\n"
-            "\textern __display__function__\n";
+            "\textern " << displayHelper.symbol << "\n"
+            "\textern " << flushHelper.symbol << "\n"
+            "\textern __output__line_buffered__\n";
 
     // add _start prologue
     code << "_start:\n"
             "\tpush rbp\n"
             "\tmov rbp, rsp\n"
             "\tsub rsp, " << 8 * builderIR.getTempVarsCount() + symbolTable.getOffset() << "\n";
+
+    if(lineBufferedOutput)
+        code << "\tmov byte [__output__line_buffered__], 1\n";
     
     // generate code
-    auto& instructions = builderIR.getCode();
-    InstructionGenerator generator(code, builderIR, symbolTable);
+    auto variableRegisters = allocateVariableRegisters(builderIR, {&displayHelper, &flushHelper});
+    InstructionGenerator generator(code, builderIR, symbolTable, variableRegisters);
     
-    for(auto& instruction : instructions)
+    for(std::size_t i = 0; i < builderIR.size(); ++i)
     {
-        std::visit(generator, instruction);
+        generator.generate(i);
     }
     
     // add _start epilogue
-    code << "\tmov rsp, rbp\n"
+    code << "\tcall " << flushHelper.symbol << "\n"
+            "\tmov rsp, rbp\n"
             "\tpop rbp\n";
 
     // exit
     code << "\tmov rax, 60\n"
             "\txor rdi, rdi\n"
             "\tsyscall";
-
-    code.close();
-    return name + ".asm";
 }
 
 std::string CodeGen::generateObjectFile(const std::string &name)
 {
-    std::system(("nasm -f elf64 " + name + ".asm -o " + name + ".o").c_str());
+    std::cerr << Toolchain::assemble(getAssembly(), name + ".o");
     return name + ".o";
 }
 
-void CodeGen::linkExecutable(const std::string &name)
-{
-    std::ofstream displayFunctionAssemblyCode("__display__function__.asm");
-    displayFunctionAssemblyCode << displayFunctionAssembly;
-    displayFunctionAssemblyCode.close();
-    std::system("nasm -f elf64 __display__function__.asm -o __display__function__.o");
-    std::system(("ld __display__function__.o " + name + ".o -o " + name).c_str());
-    std::system("rm -f __display__function__.asm __display__function__.o");
-}
-
-void CodeGen::generateExecutable(const std::string &name)
-{
-    auto assemblyName = generateAssembly(name);
-    auto objectName = generateObjectFile(name);
-    linkExecutable(name);
-
-    std::system(("rm -f " + assemblyName + " " + objectName).c_str());
-}
-
-unsigned InstructionGenerator::getTempVarOffset(BuilderIR::TempVarID temp) const
-{
-    return localVariablesOffset + temp * 8;
-}
-
-std::string InstructionGenerator::getAddresFromOffset(unsigned offset) const
-{
-    std::ostringstream oss;
-    oss << "rbp-" << offset;
-    return oss.str();
-}
-
-std::string InstructionGenerator::getTempVarAddress(BuilderIR::TempVarID temp) const
+void CodeGen::linkExecutable(const std::string &objectFile, const std::string &name)
 {
-    return getAddresFromOffset(getTempVarOffset(temp));
+    std::cerr << Toolchain::link({getRuntimeObject(), objectFile}, name);
 }
 
-std::string InstructionGenerator::convertAddressToValue(const std::string &address) const
+std::string CodeGen::generateExecutable(const std::string &name)
 {
-    return "qword [" + address + "]";
+    return buildExecutable(getAssembly(), name);
 }
 
-std::string InstructionGenerator::generateMovImmediate(const std::string &to, int immediate) const
+std::string CodeGen::buildExecutable(std::string_view assembly, const std::string &name)
 {
-    std::ostringstream oss;
-    oss << immediate;
-    return generateMov(to, oss.str());
-}
+    Toolchain::TemporaryDirectory temporary;
+    auto object = temporary.path() / (std::filesystem::path(name).filename().string() + ".o");
 
-std::string InstructionGenerator::generateMovImmediateToTempVar(BuilderIR::TempVarID temp, int immediate) const
-{
-    std::ostringstream oss;
-    oss << immediate;
-    return generateMovToTempVar(temp, oss.str());
+    auto diagnostics = Toolchain::assemble(assembly, object);
+    diagnostics += Toolchain::link({getRuntimeObject(), object}, name);
+    return diagnostics;
 }
 
-std::string InstructionGenerator::generateMovToTempVar(BuilderIR::TempVarID temp, const std::string &from) const
+std::filesystem::path CodeGen::getRuntimeObject()
 {
-    auto destination = convertAddressToValue(getTempVarAddress(temp));
-    return generateMov(destination, from);
-}
+    std::ostringstream fileName;
+    fileName << "runtime-" << std::hex << std::setw(16) << std::setfill('0') << Toolchain::hash(displayFunctionAssembly) << ".o";
 
-std::string InstructionGenerator::generateMovFromTempVar(const std::string &to, BuilderIR::TempVarID temp) const
-{
-    auto source = convertAddressToValue(getTempVarAddress(temp));
-    return generateMov(to, source);
-}
+    auto object = Toolchain::getCacheDirectory() / fileName.str();
 
-std::string InstructionGenerator::generateMovImmediateToLocalVar(unsigned variableOffset, int immediate) const
-{
-    std::ostringstream oss;
-    oss << immediate;
-    return generateMovToLocalVar(variableOffset, oss.str());
-}
-
-std::string InstructionGenerator::generateMovToLocalVar(unsigned variableOffset, const std::string& from) const
-{
-    auto destination = convertAddressToValue(getAddresFromOffset(variableOffset));
-    return generateMov(destination, from);
-}
+    // the staging name is only unique per process, so threads of a batch build take turns
+    static std::mutex mutex;
+    std::lock_guard lock(mutex);
+    if(std::filesystem::exists(object)) return object;
 
-std::string InstructionGenerator::generateMovFromLocalVar(const std::string& to, unsigned variableOffset) const
-{
-    auto source = convertAddressToValue(getAddresFromOffset(variableOffset));
-    return generateMov(to, source);
-}
+    Toolchain::TemporaryDirectory temporary;
+    auto built = temporary.path() / "runtime.o";
+    Toolchain::assemble(displayFunctionAssembly, built);
 
-void InstructionGenerator::operator()(BuilderIR::InstructionLoad load) const
-{
-    os << generateMovFromLocalVar("rax", load.offset);
-    os << generateMovToTempVar(load.destination, "rax");
-}
+    // publish with a rename so that concurrent compilers only ever see a complete object
+    auto staging = object;
+    staging += "." + std::to_string(getpid()) + ".tmp";
+    std::filesystem::copy_file(built, staging, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::rename(staging, object);
 
-void InstructionGenerator::operator()(BuilderIR::InstructionStore store) const
-{
-    switch(store.value.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediateToLocalVar(store.offset, store.value.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rax", store.value.tempVar);
-            os << generateMovToLocalVar(store.offset, "rax");
-        } break;
-    }
+    return object;
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionBinaryOperation binaryOperation) const
+InstructionGenerator::InstructionGenerator(AssemblyBuffer& out, const BuilderIR& builderIR, const SymbolTable& symbolTable, const std::unordered_map<unsigned, std::string_view>& allocation)
+    : out(out), builderIR(builderIR), localVariablesOffset(symbolTable.getOffset() + 8)
 {
-    auto leftOperand = binaryOperation.leftOperand;
-    auto rightOperand = binaryOperation.rightOperand;
-
-    switch(leftOperand.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rax", leftOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rax", leftOperand.tempVar);
-        } break;
-    }
-
-    switch(rightOperand.type)
+    for(auto [offset, reg] : allocation)
     {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rbx", rightOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rbx", rightOperand.tempVar);   
-        } break;
-    }
-
-    switch(binaryOperation.operation)
-    {
-        case BuilderIR::InstructionBinaryOperation::Operation::Addition: {
-            os << "\tadd rax, rbx\n";
-        } break;
-        case BuilderIR::InstructionBinaryOperation::Operation::Subtraction: {
-            os << "\tsub rax, rbx\n";
-        } break;
-        case BuilderIR::InstructionBinaryOperation::Operation::Multiplication: {
-            os << "\tmul rax, rbx\n";
-        } break;
-        case BuilderIR::InstructionBinaryOperation::Operation::Division: {
-            os << "\txor rdx, rdx\n";
-            os << "\tdiv rbx\n";
-        } break;
-        case BuilderIR::InstructionBinaryOperation::Operation::Modulo: {
-            os << "\txor rdx, rdx\n";
-            os << "\tdiv rbx\n";
-            os << generateMovToTempVar(binaryOperation.destination, "rdx");
-            return;
-        } break;
-        default: {
-            return;
-        }
+        if(offset / 8 >= variableRegisters.size()) variableRegisters.resize(offset / 8 + 1);
+        variableRegisters[offset / 8] = reg;
     }
-
-    os << generateMovToTempVar(binaryOperation.destination, "rax");
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionUnaryOperator unaryOperation) const
+std::string_view InstructionGenerator::getRegister(unsigned variableOffset) const
 {
-    auto operand = unaryOperation.operand;
-
-    switch(operand.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rax", operand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rax", operand.tempVar);
-        } break;
-    }
-
-    switch(unaryOperation.operation)
-    {
-        case BuilderIR::InstructionUnaryOperator::Operation::Negation: {
-            os << "\tneg rax\n";
-        } break;
-    }
-
-    os << generateMovToTempVar(unaryOperation.destination, "rax");
+    return variableOffset / 8 < variableRegisters.size() ? variableRegisters[variableOffset / 8] : std::string_view();
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionLabel label) const
+void InstructionGenerator::writeTempVar(BuilderIR::TempVarID temp)
 {
-    os << ".L" << label.label << ":\n";
+    out << "qword [rbp-" << localVariablesOffset + temp * 8 << "]";
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionJump jump) const
+void InstructionGenerator::writeLocalVar(unsigned variableOffset)
 {
-    os << "\tjmp .L" << jump.destination << "\n";
+    auto reg = getRegister(variableOffset);
+    if(!reg.empty()) out << reg;
+    else out << "qword [rbp-" << variableOffset << "]";
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionBranch branch) const
+void InstructionGenerator::writeOperand(BuilderIR::Word word)
 {
-    auto condition = branch.condition;
-    
-    switch(condition.type)
+    auto operand = builderIR.getOperand(word);
+    switch(operand.type)
     {
         case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rax", condition.immediate);
+            out << operand.immediate;
         } break;
         case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rax", condition.tempVar);
+            writeTempVar(operand.tempVar);
         } break;
     }
-
-    os <<   "\ttest rax, rax\n"
-            "\tjnz .L" << branch.ifTrue << "\n"
-            "\tjmp .L" << branch.ifFalse << "\n";
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionDisplay display) const
+void InstructionGenerator::writeLabel(BuilderIR::LabelID label)
 {
-    auto operand = display.operand;
-
-    switch(operand.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rdi", operand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rdi", operand.tempVar);
-        } break;
-    }
-
-    os << "\tcall __display__function__\n";
+    out << ".L" << label;
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionSet set) const
+void InstructionGenerator::generateMovOperand(std::string_view to, BuilderIR::Word word)
 {
-    os << generateMovImmediateToTempVar(set.destination, set.value);
+    out << "\tmov " << to << ", ";
+    writeOperand(word);
+    out << "\n";
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionCompareEqual cmpEqual) const
+void InstructionGenerator::generateMovToTempVar(BuilderIR::TempVarID temp, std::string_view from)
 {
-    auto leftOperand = cmpEqual.leftOperand;
-    auto rightOperand = cmpEqual.rightOperand;
-
-    switch(leftOperand.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rax", leftOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rax", leftOperand.tempVar);
-        } break;
-    }
-
-    switch(rightOperand.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rbx", rightOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rbx", rightOperand.tempVar);
-        } break;
-    }
-
-    os <<   "\tcmp rax, rbx\n"
-            "\tje .L" << cmpEqual.ifEqual << "\n"
-            "\tjmp .L" << cmpEqual.ifNotEqual << "\n";
+    out << "\tmov ";
+    writeTempVar(temp);
+    out << ", " << from << "\n";
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionCompareLess cmpLess) const
+void InstructionGenerator::generateJumps(std::string_view jump, BuilderIR::LabelID ifTrue, BuilderIR::LabelID ifFalse)
 {
-    auto leftOperand = cmpLess.leftOperand;
-    auto rightOperand = cmpLess.rightOperand;
-
-    switch(leftOperand.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rax", leftOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rax", leftOperand.tempVar);
-        } break;
-    }
-
-    switch(rightOperand.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rbx", rightOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rbx", rightOperand.tempVar);
-        } break;
-    }
-
-    os <<   "\tcmp rax, rbx\n"
-            "\tjl .L" << cmpLess.ifLess << "\n"
-            "\tjmp .L" << cmpLess.ifMore << "\n";
+    out << "\t" << jump << " ";
+    writeLabel(ifTrue);
+    out << "\n\tjmp ";
+    writeLabel(ifFalse);
+    out << "\n";
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionCompareMore cmpMore) const
+// The conditional jump taken to the first target of a compare instruction
+static std::string_view getJump(BuilderIR::Opcode opcode)
 {
-    auto leftOperand = cmpMore.leftOperand;
-    auto rightOperand = cmpMore.rightOperand;
-
-    switch(leftOperand.type)
+    switch(opcode.kind)
     {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rax", leftOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rax", leftOperand.tempVar);
-        } break;
+        case BuilderIR::Kind::CompareEqual: return "je";
+        case BuilderIR::Kind::CompareMore: return "jg";
+        case BuilderIR::Kind::CompareLess: return "jl";
+        default: break;
     }
 
-    switch(rightOperand.type)
+    switch(static_cast<BuilderIR::InstructionBranchCmp::ComparisonType>(opcode.operation))
     {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rbx", rightOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rbx", rightOperand.tempVar);
-        } break;
+        case BuilderIR::InstructionBranchCmp::ComparisonType::Equals: return "je";
+        case BuilderIR::InstructionBranchCmp::ComparisonType::NotEquals: return "jne";
+        case BuilderIR::InstructionBranchCmp::ComparisonType::Greater: return "jg";
+        case BuilderIR::InstructionBranchCmp::ComparisonType::GreaterEqual: return "jge";
+        case BuilderIR::InstructionBranchCmp::ComparisonType::Less: return "jl";
+        case BuilderIR::InstructionBranchCmp::ComparisonType::LessEqual: return "jle";
     }
-
-    os <<   "\tcmp rax, rbx\n"
-            "\tjg .L" << cmpMore.ifMore << "\n"
-            "\tjmp .L" << cmpMore.ifLess << "\n";
+    return "jmp";
 }
 
-void InstructionGenerator::operator()(BuilderIR::InstructionBranchCmp branchCmp) const
+void InstructionGenerator::generate(std::size_t index)
 {
-    auto leftOperand = branchCmp.leftOperand;
-    auto rightOperand = branchCmp.rightOperand;
-
-    switch(leftOperand.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rax", leftOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rax", leftOperand.tempVar);
-        } break;
-    }
-
-    switch(rightOperand.type)
-    {
-        case BuilderIR::Operand::Type::Immediate: {
-            os << generateMovImmediate("rbx", rightOperand.immediate);
-        } break;
-        case BuilderIR::Operand::Type::Temporary: {
-            os << generateMovFromTempVar("rbx", rightOperand.tempVar);
-        } break;
-    }
-
-    os << "\tcmp rax, rbx\n";
+    auto opcode = builderIR.getOpcode(index);
+    const auto& words = builderIR.getWords(index);
 
-    switch(branchCmp.type)
+    switch(opcode.kind)
     {
-        case BuilderIR::InstructionBranchCmp::ComparisonType::Equals: {
-            os << "\tje";
-        } break;
-        case BuilderIR::InstructionBranchCmp::ComparisonType::NotEquals: {
-            os << "\tjne";
-        } break;
-        case BuilderIR::InstructionBranchCmp::ComparisonType::Greater: {
-            os << "\tjg";
-        } break;
-        case BuilderIR::InstructionBranchCmp::ComparisonType::GreaterEqual: {
-            os << "\tjge";
-        } break;
-        case BuilderIR::InstructionBranchCmp::ComparisonType::Less: {
-            os << "\tjl";
-        } break;
-        case BuilderIR::InstructionBranchCmp::ComparisonType::LessEqual: {
-            os << "\tjle";
+        case BuilderIR::Kind::Load: {
+            auto reg = getRegister(words[1]);
+            if(!reg.empty())
+            {
+                generateMovToTempVar(words[0], reg);
+                break;
+            }
+            out << "\tmov rax, ";
+            writeLocalVar(words[1]);
+            out << "\n";
+            generateMovToTempVar(words[0], "rax");
+        } break;
+        case BuilderIR::Kind::Store: {
+            auto value = builderIR.getOperand(words[1]);
+            if(value.type == BuilderIR::Operand::Type::Immediate)
+            {
+                out << "\tmov ";
+                writeLocalVar(words[0]);
+                out << ", " << value.immediate << "\n";
+                break;
+            }
+            auto reg = getRegister(words[0]);
+            if(!reg.empty())
+            {
+                generateMovOperand(reg, words[1]);
+                break;
+            }
+            generateMovOperand("rax", words[1]);
+            out << "\tmov ";
+            writeLocalVar(words[0]);
+            out << ", rax\n";
+        } break;
+        case BuilderIR::Kind::BinaryOperation: {
+            generateMovOperand("rax", words[1]);
+            generateMovOperand("rbx", words[2]);
+
+            switch(static_cast<BuilderIR::InstructionBinaryOperation::Operation>(opcode.operation))
+            {
+                case BuilderIR::InstructionBinaryOperation::Operation::Addition: {
+                    out << "\tadd rax, rbx\n";
+                } break;
+                case BuilderIR::InstructionBinaryOperation::Operation::Subtraction: {
+                    out << "\tsub rax, rbx\n";
+                } break;
+                case BuilderIR::InstructionBinaryOperation::Operation::Multiplication: {
+                    out << "\timul rax, rbx\n";
+                } break;
+                case BuilderIR::InstructionBinaryOperation::Operation::Division: {
+                    out << "\tcqo\n"
+                           "\tidiv rbx\n";
+                } break;
+                case BuilderIR::InstructionBinaryOperation::Operation::Modulo: {
+                    out << "\tcqo\n"
+                           "\tidiv rbx\n";
+                    generateMovToTempVar(words[0], "rdx");
+                    return;
+                } break;
+                default: {
+                    // logical and relational operations are lowered to compares and branches
+                    throw std::runtime_error("Binary operation without a native encoding in the IR");
+                }
+            }
+
+            generateMovToTempVar(words[0], "rax");
+        } break;
+        case BuilderIR::Kind::UnaryOperator: {
+            generateMovOperand("rax", words[1]);
+
+            switch(static_cast<BuilderIR::InstructionUnaryOperator::Operation>(opcode.operation))
+            {
+                case BuilderIR::InstructionUnaryOperator::Operation::Negation: {
+                    out << "\tneg rax\n";
+                } break;
+                default: {
+                    // Not is lowered to a branch
+                    throw std::runtime_error("Unary operation without a native encoding in the IR");
+                }
+            }
+
+            generateMovToTempVar(words[0], "rax");
+        } break;
+        case BuilderIR::Kind::Label: {
+            writeLabel(words[0]);
+            out << ":\n";
+        } break;
+        case BuilderIR::Kind::Jump: {
+            out << "\tjmp ";
+            writeLabel(words[0]);
+            out << "\n";
+        } break;
+        case BuilderIR::Kind::Branch: {
+            generateMovOperand("rax", words[0]);
+            out << "\ttest rax, rax\n";
+            generateJumps("jnz", words[1], words[2]);
+        } break;
+        case BuilderIR::Kind::Display: {
+            generateMovOperand(displayHelper.argumentRegister, words[0]);
+            out << "\tcall " << displayHelper.symbol << "\n";
+        } break;
+        case BuilderIR::Kind::Set: {
+            out << "\tmov ";
+            writeTempVar(words[0]);
+            out << ", " << static_cast<int>(words[1]) << "\n";
+        } break;
+        case BuilderIR::Kind::CompareEqual:
+        case BuilderIR::Kind::CompareMore:
+        case BuilderIR::Kind::CompareLess:
+        case BuilderIR::Kind::BranchCmp: {
+            generateMovOperand("rax", words[0]);
+            generateMovOperand("rbx", words[1]);
+            out << "\tcmp rax, rbx\n";
+
+            const auto& targets = builderIR.getTargets(words[2]);
+            generateJumps(getJump(opcode), targets.first, targets.second);
         } break;
     }
-
-    os <<   " .L" << branchCmp.ifTrue << "\n"
-            "\tjmp .L" << branchCmp.ifFalse << "\n";
 }
@@ -2,6 +2,7 @@
 
 #include "IR.hpp"
 #include "SymbolTable.hpp"
+#include <filesystem>
 
 // namespace CodeGen {
 //     std::string generateAssembly(std::string_view fileName, const BuilderIR& builderIR, const SymbolTable& symbolTable);
@@ -11,17 +12,30 @@
 //     void generateCode(std::string_view fileName, const BuilderIR& builderIR, const SymbolTable& symbolTable);
 // };
 
+class AssemblyBuffer;
+
 class CodeGen {
 public:
-    CodeGen(const BuilderIR& builderIR, const SymbolTable& symbolTable);
+    CodeGen(const BuilderIR& builderIR, const SymbolTable& symbolTable, bool lineBufferedOutput = false);
 
+    // The whole program's assembly, formatted into a single buffer
+    std::string getAssembly();
     std::string generateAssembly(const std::string& name);
+    void writeAssembly(std::ostream& os);
     std::string generateObjectFile(const std::string& name);
-    void linkExecutable(const std::string& name);
+    void linkExecutable(const std::string& objectFile, const std::string& name);
+
+    // Returns the warnings printed by the assembler and linker
+    std::string generateExecutable(const std::string& name);
+    static std::string buildExecutable(std::string_view assembly, const std::string& name);
 
-    void generateExecutable(const std::string& name);
+    // The display runtime is assembled once per runtime version and kept in the cache directory
+    static std::filesystem::path getRuntimeObject();
 
 private:
+    void emitAssembly(AssemblyBuffer& code);
+
     const BuilderIR& builderIR;
     const SymbolTable& symbolTable;
+    const bool lineBufferedOutput;
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "IR.hpp"
+#include <type_traits>
 #include <unordered_set>
 
 BuilderIR::Operand BuilderIR::Operand::Immediate(int value)
@@ -39,188 +40,226 @@ inline static std::unordered_map<AST::UnaryOperation::OperationType, BuilderIR::
     {AST::UnaryOperation::OperationType::Not, BuilderIR::InstructionUnaryOperator::Operation::Not}
 }};
 
-BuilderIR::Operand BuilderIR::lowerExpression(const std::unique_ptr<AST::Expression>& expression)
+BuilderIR::Operand BuilderIR::lowerExpression(const AST::Ptr<AST::Expression>& expression)
 {
-    if(auto value = expression->getValue())
+    pendingExpressions.clear();
+    operands.clear();
+    pendingExpressions.push_back({expression.get(), false});
+    while(!pendingExpressions.empty())
     {
-        return Operand::Immediate(value.value());
-    }
+        auto [next, operandsLowered] = pendingExpressions.back();
+        pendingExpressions.pop_back();
 
-    if(auto* identificator = dynamic_cast<AST::VariableValue*>(expression.get()))
-    {
-        TempVarID temp = allocateTempVar();
-        auto& variable = *dynamic_cast<AST::VariableData*>(identificator);
-        emit(InstructionLoad(temp, variable));
-        return Operand::TempVar(temp);
+        if(!operandsLowered && next->kind == AST::Expression::Kind::BinaryOperation)
+        {
+            auto* binary = static_cast<const AST::BinaryOperation*>(next);
+            pendingExpressions.push_back({next, true});
+            pendingExpressions.push_back({binary->rightOperand.get(), false});
+            pendingExpressions.push_back({binary->leftOperand.get(), false});
+            continue;
+        }
+        if(!operandsLowered && next->kind == AST::Expression::Kind::UnaryOperation)
+        {
+            pendingExpressions.push_back({next, true});
+            pendingExpressions.push_back({static_cast<const AST::UnaryOperation*>(next)->operand.get(), false});
+            continue;
+        }
+
+        operands.push_back(AST::visit([this](auto& node) { return lower(node); }, *next));
     }
+    return operands.back();
+}
 
-    if(auto* unary = dynamic_cast<AST::UnaryOperation*>(expression.get()))
-    {
-        auto operation = unary->operation;
-        Operand operand = lowerExpression(unary->operand);
+BuilderIR::Operand BuilderIR::popOperand()
+{
+    auto operand = operands.back();
+    operands.pop_back();
+    return operand;
+}
 
-        if(operation == AST::UnaryOperation::OperationType::Identity) return operand;
-        auto operationIR = astUnopToIrUnop.at(operation);
+BuilderIR::Operand BuilderIR::lower(const AST::LiteralValue& literal)
+{
+    return Operand::Immediate(literal.value);
+}
 
-        switch(operationIR)
-        {
-            case BuilderIR::InstructionUnaryOperator::Operation::Negation: {
-                TempVarID temp = allocateTempVar();
-                emit(InstructionUnaryOperator(temp, operand));
-                return Operand::TempVar(temp);
-            }
-            case BuilderIR::InstructionUnaryOperator::Operation::Not: {
-                TempVarID temp = allocateTempVar();
-                LabelID valueTrue = allocateLabel();
-                LabelID valueFalse = allocateLabel();
-                LabelID done = allocateLabel();
-                emit(InstructionBranch(operand, valueFalse, valueTrue));
-                emit(InstructionLabel(valueFalse));
-                emit(InstructionSet(temp, 0));
-                emit(InstructionJump(done));
-                emit(InstructionLabel(valueTrue));
-                emit(InstructionSet(temp, 1));
-                emit(InstructionLabel(done));
-                return Operand::TempVar(temp);
-            }
+BuilderIR::Operand BuilderIR::lower(const AST::VariableValue& variable)
+{
+    TempVarID temp = allocateTempVar();
+    emit(InstructionLoad(temp, variable));
+    return Operand::TempVar(temp);
+}
+
+BuilderIR::Operand BuilderIR::lower(const AST::UnaryOperation& unary)
+{
+    auto operation = unary.operation;
+    Operand operand = popOperand();
+
+    // only constant expressions lower to immediates, so this folds them
+    if(operand.type == Operand::Type::Immediate) return Operand::Immediate(AST::UnaryOperation::operations.at(operation)(operand.immediate));
+    if(operation == AST::UnaryOperation::OperationType::Identity) return operand;
+    auto operationIR = astUnopToIrUnop.at(operation);
+
+    switch(operationIR)
+    {
+        case BuilderIR::InstructionUnaryOperator::Operation::Negation: {
+            TempVarID temp = allocateTempVar();
+            emit(InstructionUnaryOperator(temp, operand));
+            return Operand::TempVar(temp);
+        }
+        case BuilderIR::InstructionUnaryOperator::Operation::Not: {
+            TempVarID temp = allocateTempVar();
+            LabelID valueTrue = allocateLabel();
+            LabelID valueFalse = allocateLabel();
+            LabelID done = allocateLabel();
+            emit(InstructionBranch(operand, valueFalse, valueTrue));
+            emit(InstructionLabel(valueFalse));
+            emit(InstructionSet(temp, 0));
+            emit(InstructionJump(done));
+            emit(InstructionLabel(valueTrue));
+            emit(InstructionSet(temp, 1));
+            emit(InstructionLabel(done));
+            return Operand::TempVar(temp);
         }
     }
 
-    if(auto* binary = dynamic_cast<AST::BinaryOperation*>(expression.get()))
-    {
-        Operand leftOperand = lowerExpression(binary->leftOperand);
-        Operand rightOperand = lowerExpression(binary->rightOperand);
+    throw std::runtime_error("Unrecognized unary operation, unable to lower");
+}
 
-        auto operation = astBinopToIrBinop.at(binary->operation);
-        switch(operation)
-        {
-            case BuilderIR::InstructionBinaryOperation::Operation::And: {
-                TempVarID temp = allocateTempVar();
-                LabelID keepChecking = allocateLabel();
-                LabelID valueTrue = allocateLabel();
-                LabelID valueFalse = allocateLabel();
-                LabelID done = allocateLabel();
-                emit(InstructionBranch(leftOperand, keepChecking, valueFalse));
-                emit(InstructionLabel(keepChecking));
-                emit(InstructionBranch(rightOperand, valueTrue, valueFalse));
-                emit(InstructionLabel(valueTrue));
-                emit(InstructionSet(temp, 1));
-                emit(InstructionJump(done));
-                emit(InstructionLabel(valueFalse));
-                emit(InstructionSet(temp, 0));
-                emit(InstructionLabel(done));
-                return Operand::TempVar(temp);
-            }
-            case BuilderIR::InstructionBinaryOperation::Operation::Or: {
-                TempVarID temp = allocateTempVar();
-                LabelID keepChecking = allocateLabel();
-                LabelID valueFalse = allocateLabel();
-                LabelID valueTrue = allocateLabel();
-                LabelID done = allocateLabel();
-                emit(InstructionBranch(leftOperand, valueTrue, keepChecking));
-                emit(InstructionLabel(keepChecking));
-                emit(InstructionBranch(rightOperand, valueTrue, valueFalse));
-                emit(InstructionLabel(valueFalse));
-                emit(InstructionSet(temp, 0));
-                emit(InstructionJump(done));
-                emit(InstructionLabel(valueTrue));
-                emit(InstructionSet(temp, 1));
-                emit(InstructionLabel(done));
-                return Operand::TempVar(temp);
-            }
-            case BuilderIR::InstructionBinaryOperation::Operation::Equals: {
-                TempVarID temp = allocateTempVar();
-                LabelID equal = allocateLabel();
-                LabelID notEqual = allocateLabel();
-                LabelID done = allocateLabel();
-                emit(InstructionCompareEqual(leftOperand, rightOperand, equal, notEqual));
-                emit(InstructionLabel(equal));
-                emit(InstructionSet(temp, 1));
-                emit(InstructionJump(done));
-                emit(InstructionLabel(notEqual));
-                emit(InstructionSet(temp, 0));
-                emit(InstructionLabel(done));
-                return Operand::TempVar(temp);
-            }
-            case BuilderIR::InstructionBinaryOperation::Operation::NotEquals: {
-                TempVarID temp = allocateTempVar();
-                LabelID notEqual = allocateLabel();
-                LabelID equal = allocateLabel();
-                LabelID done = allocateLabel();
-                emit(InstructionCompareEqual(leftOperand, rightOperand, equal, notEqual));
-                emit(InstructionLabel(equal));
-                emit(InstructionSet(temp, 0));
-                emit(InstructionJump(done));
-                emit(InstructionLabel(notEqual));
-                emit(InstructionSet(temp, 1));
-                emit(InstructionLabel(done));
-                return Operand::TempVar(temp);
-            }
-            case BuilderIR::InstructionBinaryOperation::Operation::GreaterEqual: {
-                TempVarID temp = allocateTempVar();
-                LabelID valueFalse = allocateLabel();
-                LabelID valueTrue = allocateLabel();
-                LabelID done = allocateLabel();
-                emit(InstructionCompareLess(leftOperand, rightOperand, valueFalse, valueTrue));
-                emit(InstructionLabel(valueFalse));
-                emit(InstructionSet(temp, 0));
-                emit(InstructionJump(done));
-                emit(InstructionLabel(valueTrue));
-                emit(InstructionSet(temp, 1));
-                emit(InstructionLabel(done));
-                return Operand::TempVar(temp);
-            }
-            case BuilderIR::InstructionBinaryOperation::Operation::GreaterThan: {
-                TempVarID temp = allocateTempVar();
-                LabelID valueTrue = allocateLabel();
-                LabelID valueFalse = allocateLabel();
-                LabelID done = allocateLabel();
-                emit(InstructionCompareMore(leftOperand, rightOperand, valueTrue, valueFalse));
-                emit(InstructionLabel(valueTrue));
-                emit(InstructionSet(temp, 1));
-                emit(InstructionJump(done));
-                emit(InstructionLabel(valueFalse));
-                emit(InstructionSet(temp, 0));
-                emit(InstructionLabel(done));
-                return Operand::TempVar(temp);
-            }
-            case BuilderIR::InstructionBinaryOperation::Operation::LessEqual: {
-                TempVarID temp = allocateTempVar();
-                LabelID valueFalse = allocateLabel();
-                LabelID valueTrue = allocateLabel();
-                LabelID done = allocateLabel();
-                emit(InstructionCompareMore(leftOperand, rightOperand, valueFalse, valueTrue));
-                emit(InstructionLabel(valueTrue));
-                emit(InstructionSet(temp, 1));
-                emit(InstructionJump(done));
-                emit(InstructionLabel(valueFalse));
-                emit(InstructionSet(temp, 0));
-                emit(InstructionLabel(done));
-                return Operand::TempVar(temp);
-            }
-            case BuilderIR::InstructionBinaryOperation::Operation::LessThan: {
-                TempVarID temp = allocateTempVar();
-                LabelID valueTrue = allocateLabel();
-                LabelID valueFalse = allocateLabel();
-                LabelID done = allocateLabel();
-                emit(InstructionCompareLess(leftOperand, rightOperand, valueTrue, valueFalse));
-                emit(InstructionLabel(valueFalse));
-                emit(InstructionSet(temp, 0));
-                emit(InstructionJump(done));
-                emit(InstructionLabel(valueTrue));
-                emit(InstructionSet(temp, 1));
-                emit(InstructionLabel(done));
-                return Operand::TempVar(temp);
-            }
-            default: {
-                TempVarID temp = allocateTempVar();
-                emit(InstructionBinaryOperation(temp, astBinopToIrBinop.at(binary->operation), leftOperand, rightOperand));
-                return Operand::TempVar(temp);
-            }
+BuilderIR::Operand BuilderIR::lower(const AST::BinaryOperation& binary)
+{
+    Operand rightOperand = popOperand();
+    Operand leftOperand = popOperand();
+
+    if(leftOperand.type == Operand::Type::Immediate && rightOperand.type == Operand::Type::Immediate)
+        return Operand::Immediate(AST::BinaryOperation::operations.at(binary.operation)(leftOperand.immediate, rightOperand.immediate));
+
+    auto operation = astBinopToIrBinop.at(binary.operation);
+    switch(operation)
+    {
+        case BuilderIR::InstructionBinaryOperation::Operation::And: {
+            TempVarID temp = allocateTempVar();
+            LabelID keepChecking = allocateLabel();
+            LabelID valueTrue = allocateLabel();
+            LabelID valueFalse = allocateLabel();
+            LabelID done = allocateLabel();
+            emit(InstructionBranch(leftOperand, keepChecking, valueFalse));
+            emit(InstructionLabel(keepChecking));
+            emit(InstructionBranch(rightOperand, valueTrue, valueFalse));
+            emit(InstructionLabel(valueTrue));
+            emit(InstructionSet(temp, 1));
+            emit(InstructionJump(done));
+            emit(InstructionLabel(valueFalse));
+            emit(InstructionSet(temp, 0));
+            emit(InstructionLabel(done));
+            return Operand::TempVar(temp);
+        }
+        case BuilderIR::InstructionBinaryOperation::Operation::Or: {
+            TempVarID temp = allocateTempVar();
+            LabelID keepChecking = allocateLabel();
+            LabelID valueFalse = allocateLabel();
+            LabelID valueTrue = allocateLabel();
+            LabelID done = allocateLabel();
+            emit(InstructionBranch(leftOperand, valueTrue, keepChecking));
+            emit(InstructionLabel(keepChecking));
+            emit(InstructionBranch(rightOperand, valueTrue, valueFalse));
+            emit(InstructionLabel(valueFalse));
+            emit(InstructionSet(temp, 0));
+            emit(InstructionJump(done));
+            emit(InstructionLabel(valueTrue));
+            emit(InstructionSet(temp, 1));
+            emit(InstructionLabel(done));
+            return Operand::TempVar(temp);
+        }
+        case BuilderIR::InstructionBinaryOperation::Operation::Equals: {
+            TempVarID temp = allocateTempVar();
+            LabelID equal = allocateLabel();
+            LabelID notEqual = allocateLabel();
+            LabelID done = allocateLabel();
+            emit(InstructionCompareEqual(leftOperand, rightOperand, equal, notEqual));
+            emit(InstructionLabel(equal));
+            emit(InstructionSet(temp, 1));
+            emit(InstructionJump(done));
+            emit(InstructionLabel(notEqual));
+            emit(InstructionSet(temp, 0));
+            emit(InstructionLabel(done));
+            return Operand::TempVar(temp);
+        }
+        case BuilderIR::InstructionBinaryOperation::Operation::NotEquals: {
+            TempVarID temp = allocateTempVar();
+            LabelID notEqual = allocateLabel();
+            LabelID equal = allocateLabel();
+            LabelID done = allocateLabel();
+            emit(InstructionCompareEqual(leftOperand, rightOperand, equal, notEqual));
+            emit(InstructionLabel(equal));
+            emit(InstructionSet(temp, 0));
+            emit(InstructionJump(done));
+            emit(InstructionLabel(notEqual));
+            emit(InstructionSet(temp, 1));
+            emit(InstructionLabel(done));
+            return Operand::TempVar(temp);
+        }
+        case BuilderIR::InstructionBinaryOperation::Operation::GreaterEqual: {
+            TempVarID temp = allocateTempVar();
+            LabelID valueFalse = allocateLabel();
+            LabelID valueTrue = allocateLabel();
+            LabelID done = allocateLabel();
+            emit(InstructionCompareLess(leftOperand, rightOperand, valueFalse, valueTrue));
+            emit(InstructionLabel(valueFalse));
+            emit(InstructionSet(temp, 0));
+            emit(InstructionJump(done));
+            emit(InstructionLabel(valueTrue));
+            emit(InstructionSet(temp, 1));
+            emit(InstructionLabel(done));
+            return Operand::TempVar(temp);
+        }
+        case BuilderIR::InstructionBinaryOperation::Operation::GreaterThan: {
+            TempVarID temp = allocateTempVar();
+            LabelID valueTrue = allocateLabel();
+            LabelID valueFalse = allocateLabel();
+            LabelID done = allocateLabel();
+            emit(InstructionCompareMore(leftOperand, rightOperand, valueTrue, valueFalse));
+            emit(InstructionLabel(valueTrue));
+            emit(InstructionSet(temp, 1));
+            emit(InstructionJump(done));
+            emit(InstructionLabel(valueFalse));
+            emit(InstructionSet(temp, 0));
+            emit(InstructionLabel(done));
+            return Operand::TempVar(temp);
+        }
+        case BuilderIR::InstructionBinaryOperation::Operation::LessEqual: {
+            TempVarID temp = allocateTempVar();
+            LabelID valueFalse = allocateLabel();
+            LabelID valueTrue = allocateLabel();
+            LabelID done = allocateLabel();
+            emit(InstructionCompareMore(leftOperand, rightOperand, valueFalse, valueTrue));
+            emit(InstructionLabel(valueTrue));
+            emit(InstructionSet(temp, 1));
+            emit(InstructionJump(done));
+            emit(InstructionLabel(valueFalse));
+            emit(InstructionSet(temp, 0));
+            emit(InstructionLabel(done));
+            return Operand::TempVar(temp);
+        }
+        case BuilderIR::InstructionBinaryOperation::Operation::LessThan: {
+            TempVarID temp = allocateTempVar();
+            LabelID valueTrue = allocateLabel();
+            LabelID valueFalse = allocateLabel();
+            LabelID done = allocateLabel();
+            emit(InstructionCompareLess(leftOperand, rightOperand, valueTrue, valueFalse));
+            emit(InstructionLabel(valueFalse));
+            emit(InstructionSet(temp, 0));
+            emit(InstructionJump(done));
+            emit(InstructionLabel(valueTrue));
+            emit(InstructionSet(temp, 1));
+            emit(InstructionLabel(done));
+            return Operand::TempVar(temp);
+        }
+        default: {
+            TempVarID temp = allocateTempVar();
+            emit(InstructionBinaryOperation(temp, astBinopToIrBinop.at(binary.operation), leftOperand, rightOperand));
+            return Operand::TempVar(temp);
         }
     }
-
-    throw std::runtime_error("Unrecognized expression, unable to lower");
 }
 
 inline static const std::unordered_map<AST::BinaryOperation::OperationType, BuilderIR::InstructionBranchCmp::ComparisonType> comparisonExpressions = {{
@@ -232,119 +271,129 @@ inline static const std::unordered_map<AST::BinaryOperation::OperationType, Buil
     {AST::BinaryOperation::OperationType::LessThan, BuilderIR::InstructionBranchCmp::ComparisonType::Less}
 }};
 
-void BuilderIR::lowerStatement(const std::unique_ptr<AST::Statement> &statement)
+void BuilderIR::lowerStatement(const AST::Ptr<AST::Statement> &statement)
 {
-    if(auto* letStatement = dynamic_cast<AST::VariableDeclaration*>(statement.get()))
+    pendingStatements.clear();
+    pendingStatements.push_back({statement.get(), 0, std::nullopt});
+    while(!pendingStatements.empty())
     {
-        Operand value = lowerExpression(letStatement->value);
-        auto& variable = *dynamic_cast<AST::VariableData*>(letStatement);
-        emit(InstructionStore(variable, value));
-        return;
-    }
+        auto next = pendingStatements.back();
+        pendingStatements.pop_back();
+        if(next.statement)
+        {
+            AST::visit([this](auto& node) { lower(node); }, *next.statement);
+            continue;
+        }
 
-    if(auto* assignStatement = dynamic_cast<AST::VariableAssignment*>(statement.get()))
-    {
-        Operand value = lowerExpression(assignStatement->value);
-        auto& variable = *dynamic_cast<AST::VariableData*>(assignStatement);
-        emit(InstructionStore(variable, value));
-        return;
+        if(next.repeat) emit(InstructionJump(*next.repeat));
+        emit(InstructionLabel(next.end));
     }
+}
 
-    if(auto* displayStatement = dynamic_cast<AST::DisplayStatement*>(statement.get()))
-    {
-        Operand expression = lowerExpression(displayStatement->expression);
-        emit(InstructionDisplay(expression));
-        return;
-    }
+void BuilderIR::lowerBody(const AST::Ptr<AST::Statement>& body, LabelID end, std::optional<LabelID> repeat)
+{
+    pendingStatements.push_back({nullptr, end, repeat});
+    pendingStatements.push_back({body.get(), 0, std::nullopt});
+}
 
-    if(auto* ifStatement = dynamic_cast<AST::IfStatement*>(statement.get()))
-    {
-        if(auto* binaryCondition = dynamic_cast<AST::BinaryOperation*>(ifStatement->condition.get()))
-        {
-            auto astOperation = binaryCondition->operation;
-            if(comparisonExpressions.find(astOperation) != comparisonExpressions.end())
-            {
-                LabelID Lthen = allocateLabel();
-                LabelID Lend = allocateLabel();
-
-                Operand leftOperand = lowerExpression(binaryCondition->leftOperand);
-                Operand rightOperand = lowerExpression(binaryCondition->rightOperand);
-
-                auto operation = comparisonExpressions.at(astOperation);
-                emit(InstructionBranchCmp(operation, leftOperand, rightOperand, Lthen, Lend));
-                emit(InstructionLabel(Lthen));
-                lowerStatement(ifStatement->body);
-                emit(InstructionLabel(Lend));
-                return;
-            }
-        }
+void BuilderIR::lower(const AST::VariableDeclaration& letStatement)
+{
+    Operand value = lowerExpression(letStatement.value);
+    emit(InstructionStore(letStatement, value));
+}
 
-        Operand condition = lowerExpression(ifStatement->condition);
-        LabelID Lthen = allocateLabel();
-        LabelID Lend = allocateLabel();
+void BuilderIR::lower(const AST::VariableAssignment& assignStatement)
+{
+    Operand value = lowerExpression(assignStatement.value);
+    emit(InstructionStore(assignStatement, value));
+}
 
-        emit(InstructionBranch(condition, Lthen, Lend));
-        emit(InstructionLabel(Lthen));
-        lowerStatement(ifStatement->body);
-        emit(InstructionLabel(Lend));
-        return;
-    }
+void BuilderIR::lower(const AST::DisplayStatement& displayStatement)
+{
+    Operand expression = lowerExpression(displayStatement.expression);
+    emit(InstructionDisplay(expression));
+}
 
-    if(auto* whileStatement = dynamic_cast<AST::WhileStatement*>(statement.get()))
+void BuilderIR::lower(const AST::IfStatement& ifStatement)
+{
+    if(ifStatement.condition->kind == AST::Expression::Kind::BinaryOperation)
     {
-        if(auto* binaryCondition = dynamic_cast<AST::BinaryOperation*>(whileStatement->condition.get()))
+        auto* binaryCondition = static_cast<const AST::BinaryOperation*>(ifStatement.condition.get());
+        auto astOperation = binaryCondition->operation;
+        if(comparisonExpressions.find(astOperation) != comparisonExpressions.end())
         {
-            auto astOperation = binaryCondition->operation;
-            if(comparisonExpressions.find(astOperation) != comparisonExpressions.end())
-            {
-                LabelID Lcond = allocateLabel();
-                LabelID Lbody = allocateLabel();
-                LabelID Lend = allocateLabel();
-
-                emit(InstructionLabel(Lcond));
-                auto operation = comparisonExpressions.at(astOperation);
-                Operand leftOperand = lowerExpression(binaryCondition->leftOperand);
-                Operand rightOperand = lowerExpression(binaryCondition->rightOperand);
-                emit(InstructionBranchCmp(operation, leftOperand, rightOperand, Lbody, Lend));
-
-                emit(InstructionLabel(Lbody));
-                lowerStatement(whileStatement->body);
-                emit(InstructionJump(Lcond));
-
-                emit(InstructionLabel(Lend));
-                return;
-            }
-        }
+            LabelID Lthen = allocateLabel();
+            LabelID Lend = allocateLabel();
 
-        LabelID Lcond = allocateLabel();
-        LabelID Lbody = allocateLabel();
-        LabelID Lend = allocateLabel();
+            Operand leftOperand = lowerExpression(binaryCondition->leftOperand);
+            Operand rightOperand = lowerExpression(binaryCondition->rightOperand);
 
-        emit(InstructionLabel(Lcond));
-        Operand condition = lowerExpression(whileStatement->condition);
-        emit(InstructionBranch(condition, Lbody, Lend));
+            auto operation = comparisonExpressions.at(astOperation);
+            emit(InstructionBranchCmp(operation, leftOperand, rightOperand, Lthen, Lend));
+            emit(InstructionLabel(Lthen));
+            lowerBody(ifStatement.body, Lend);
+            return;
+        }
+    }
 
-        emit(InstructionLabel(Lbody));
-        lowerStatement(whileStatement->body);
-        emit(InstructionJump(Lcond));
+    Operand condition = lowerExpression(ifStatement.condition);
+    LabelID Lthen = allocateLabel();
+    LabelID Lend = allocateLabel();
 
-        emit(InstructionLabel(Lend));
-        return;
-    }
+    emit(InstructionBranch(condition, Lthen, Lend));
+    emit(InstructionLabel(Lthen));
+    lowerBody(ifStatement.body, Lend);
+}
 
-    if(auto* codeBlock = dynamic_cast<AST::CodeBlock*>(statement.get()))
+void BuilderIR::lower(const AST::WhileStatement& whileStatement)
+{
+    if(whileStatement.condition->kind == AST::Expression::Kind::BinaryOperation)
     {
-        for(auto& innerStatement : codeBlock->block)
-            lowerStatement(innerStatement);
-        return;
+        auto* binaryCondition = static_cast<const AST::BinaryOperation*>(whileStatement.condition.get());
+        auto astOperation = binaryCondition->operation;
+        if(comparisonExpressions.find(astOperation) != comparisonExpressions.end())
+        {
+            LabelID Lcond = allocateLabel();
+            LabelID Lbody = allocateLabel();
+            LabelID Lend = allocateLabel();
+
+            emit(InstructionLabel(Lcond));
+            auto operation = comparisonExpressions.at(astOperation);
+            Operand leftOperand = lowerExpression(binaryCondition->leftOperand);
+            Operand rightOperand = lowerExpression(binaryCondition->rightOperand);
+            emit(InstructionBranchCmp(operation, leftOperand, rightOperand, Lbody, Lend));
+
+            emit(InstructionLabel(Lbody));
+            lowerBody(whileStatement.body, Lend, Lcond);
+            return;
+        }
     }
 
-    throw std::runtime_error("Unrecognized statement, cannot lower");
+    LabelID Lcond = allocateLabel();
+    LabelID Lbody = allocateLabel();
+    LabelID Lend = allocateLabel();
+
+    emit(InstructionLabel(Lcond));
+    Operand condition = lowerExpression(whileStatement.condition);
+    emit(InstructionBranch(condition, Lbody, Lend));
+
+    emit(InstructionLabel(Lbody));
+    lowerBody(whileStatement.body, Lend, Lcond);
+}
+
+void BuilderIR::lower(const AST::CodeBlock& codeBlock)
+{
+    // pushed last to first, so they are lowered in order
+    for(auto it = codeBlock.block.rbegin(); it != codeBlock.block.rend(); ++it)
+        pendingStatements.push_back({it->get(), 0, std::nullopt});
 }
 
-void BuilderIR::lowerProgram(const std::vector<std::unique_ptr<AST::Statement>> &statements)
+void BuilderIR::lowerProgram(const std::vector<AST::Ptr<AST::Statement>> &statements)
 {
-    code.clear();
+    opcodes.clear();
+    words.clear();
+    targets.clear();
+    constants.clear();
     nextTemp = 0;
     nextLabel = 0;
 
@@ -357,67 +406,253 @@ BuilderIR::TempVarID BuilderIR::getTempVarsCount() const
     return nextTemp;
 }
 
-BuilderIR::BuilderIR(const std::vector<std::unique_ptr<AST::Statement>> &program)
+BuilderIR::LabelID BuilderIR::getLabelsCount() const
+{
+    return nextLabel;
+}
+
+BuilderIR::BuilderIR(const std::vector<AST::Ptr<AST::Statement>> &program)
 {
     lowerProgram(program);
     tryOptimize();
 }
 
-const std::vector<BuilderIR::Instruction> &BuilderIR::getCode() const
+BuilderIR::BuilderIR(const AST::Ptr<AST::Statement> &statement)
+{
+    lowerStatement(statement);
+    tryOptimize();
+}
+
+namespace {
+    // What each word of an instruction holds, by kind, for renumbering the words of glued fragments
+    enum class Role : uint8_t {
+        None,
+        Temporary,
+        Operand,
+        Label,
+        Targets,
+        Value
+    };
+
+    constexpr std::array<std::array<Role, 3>, 13> layouts = {{
+        {Role::Temporary, Role::Value, Role::None},         // Load
+        {Role::Value, Role::Operand, Role::None},           // Store
+        {Role::Temporary, Role::Operand, Role::Operand},    // BinaryOperation
+        {Role::Temporary, Role::Operand, Role::None},       // UnaryOperator
+        {Role::Label, Role::None, Role::None},              // Label
+        {Role::Label, Role::None, Role::None},              // Jump
+        {Role::Operand, Role::Label, Role::Label},          // Branch
+        {Role::Operand, Role::None, Role::None},            // Display
+        {Role::Temporary, Role::Value, Role::None},         // Set
+        {Role::Operand, Role::Operand, Role::Targets},      // CompareEqual
+        {Role::Operand, Role::Operand, Role::Targets},      // CompareMore
+        {Role::Operand, Role::Operand, Role::Targets},      // CompareLess
+        {Role::Operand, Role::Operand, Role::Targets}       // BranchCmp
+    }};
+
+    static_assert(layouts.size() == std::variant_size_v<BuilderIR::Instruction>);
+
+    // temporaries are numbered in the upper 30 bits of an operand word
+    constexpr BuilderIR::TempVarID maxTempVars = 1u << 30;
+    constexpr int inlineImmediateLimit = 1 << 30;
+}
+
+BuilderIR::BuilderIR(const std::vector<const BuilderIR*> &fragments)
 {
-    return code;
+    std::size_t size = 0;
+    for(auto* fragment : fragments) size += fragment->size();
+    opcodes.reserve(size);
+    words.reserve(size);
+
+    for(auto* fragment : fragments)
+    {
+        if(fragment->nextTemp > maxTempVars - nextTemp) throw std::runtime_error("Too many temporaries in the program");
+
+        auto first = opcodes.size();
+        Word tempBase = nextTemp;
+        Word labelBase = nextLabel;
+        Word constantBase = constants.size();
+        Word targetBase = targets.size();
+
+        opcodes.insert(opcodes.end(), fragment->opcodes.begin(), fragment->opcodes.end());
+        words.insert(words.end(), fragment->words.begin(), fragment->words.end());
+        constants.insert(constants.end(), fragment->constants.begin(), fragment->constants.end());
+        for(auto target : fragment->targets) targets.push_back({target.first + labelBase, target.second + labelBase});
+
+        for(auto i = first; i < opcodes.size(); ++i)
+        {
+            auto& layout = layouts[static_cast<std::size_t>(opcodes[i].kind)];
+            for(std::size_t w = 0; w < layout.size(); ++w)
+            {
+                auto& word = words[i][w];
+                switch(layout[w])
+                {
+                    case Role::Temporary: word += tempBase; break;
+                    case Role::Operand: if(!(word & 1)) word += ((word & 2) ? constantBase : tempBase) << 2; break;
+                    case Role::Label: word += labelBase; break;
+                    case Role::Targets: word += targetBase; break;
+                    case Role::None:
+                    case Role::Value: break;
+                }
+            }
+        }
+
+        nextTemp += fragment->nextTemp;
+        nextLabel += fragment->nextLabel;
+    }
+}
+
+std::size_t BuilderIR::size() const
+{
+    return opcodes.size();
+}
+
+BuilderIR::Opcode BuilderIR::getOpcode(std::size_t index) const
+{
+    return opcodes[index];
+}
+
+const BuilderIR::Words &BuilderIR::getWords(std::size_t index) const
+{
+    return words[index];
+}
+
+BuilderIR::Operand BuilderIR::getOperand(Word word) const
+{
+    if(word & 1) return Operand::Immediate(static_cast<int32_t>(word) >> 1);
+    if(word & 2) return Operand::Immediate(constants[word >> 2]);
+    return Operand::TempVar(word >> 2);
+}
+
+const BuilderIR::Targets &BuilderIR::getTargets(Word word) const
+{
+    return targets[word];
+}
+
+BuilderIR::Word BuilderIR::makeOperand(const Operand &operand)
+{
+    if(operand.type == Operand::Type::Temporary) return operand.tempVar << 2;
+    if(operand.immediate >= -inlineImmediateLimit && operand.immediate < inlineImmediateLimit) return static_cast<Word>(operand.immediate) << 1 | 1;
+
+    constants.push_back(operand.immediate);
+    return static_cast<Word>(constants.size() - 1) << 2 | 2;
+}
+
+BuilderIR::Word BuilderIR::makeTargets(LabelID first, LabelID second)
+{
+    targets.push_back({first, second});
+    return targets.size() - 1;
+}
+
+BuilderIR::CodeView BuilderIR::getCode() const
+{
+    return CodeView(*this);
+}
+
+BuilderIR::Instruction BuilderIR::getInstruction(std::size_t index) const
+{
+    auto [kind, operation] = opcodes[index];
+    auto [a, b, c] = words[index];
+    switch(kind)
+    {
+        case Kind::Load: return InstructionLoad(a, b);
+        case Kind::Store: return InstructionStore(a, getOperand(b));
+        case Kind::BinaryOperation: return InstructionBinaryOperation(a, static_cast<InstructionBinaryOperation::Operation>(operation), getOperand(b), getOperand(c));
+        case Kind::UnaryOperator: return InstructionUnaryOperator(a, getOperand(b), static_cast<InstructionUnaryOperator::Operation>(operation));
+        case Kind::Label: return InstructionLabel(a);
+        case Kind::Jump: return InstructionJump(a);
+        case Kind::Branch: return InstructionBranch(getOperand(a), b, c);
+        case Kind::Display: return InstructionDisplay(getOperand(a));
+        case Kind::Set: return InstructionSet(a, static_cast<int>(b));
+        case Kind::CompareEqual: return InstructionCompareEqual(getOperand(a), getOperand(b), getTargets(c).first, getTargets(c).second);
+        case Kind::CompareMore: return InstructionCompareMore(getOperand(a), getOperand(b), getTargets(c).first, getTargets(c).second);
+        case Kind::CompareLess: return InstructionCompareLess(getOperand(a), getOperand(b), getTargets(c).first, getTargets(c).second);
+        case Kind::BranchCmp: return InstructionBranchCmp(static_cast<InstructionBranchCmp::ComparisonType>(operation), getOperand(a), getOperand(b), getTargets(c).first, getTargets(c).second);
+    }
+    throw std::runtime_error("Unrecognized instruction kind");
+}
+
+void BuilderIR::append(const Instruction &instruction)
+{
+    auto kind = static_cast<Kind>(instruction.index());
+    auto [operation, packed] = std::visit([this](auto& instruction) -> std::pair<uint8_t, Words> {
+        using T = std::decay_t<decltype(instruction)>;
+        if constexpr (std::is_same_v<T, InstructionLoad>) return {0, {instruction.destination, instruction.offset, 0}};
+        if constexpr (std::is_same_v<T, InstructionStore>) return {0, {instruction.offset, makeOperand(instruction.value), 0}};
+        if constexpr (std::is_same_v<T, InstructionBinaryOperation>)
+            return {static_cast<uint8_t>(instruction.operation), {instruction.destination, makeOperand(instruction.leftOperand), makeOperand(instruction.rightOperand)}};
+        if constexpr (std::is_same_v<T, InstructionUnaryOperator>)
+            return {static_cast<uint8_t>(instruction.operation), {instruction.destination, makeOperand(instruction.operand), 0}};
+        if constexpr (std::is_same_v<T, InstructionLabel>) return {0, {instruction.label, 0, 0}};
+        if constexpr (std::is_same_v<T, InstructionJump>) return {0, {instruction.destination, 0, 0}};
+        if constexpr (std::is_same_v<T, InstructionBranch>) return {0, {makeOperand(instruction.condition), instruction.ifTrue, instruction.ifFalse}};
+        if constexpr (std::is_same_v<T, InstructionDisplay>) return {0, {makeOperand(instruction.operand), 0, 0}};
+        if constexpr (std::is_same_v<T, InstructionSet>) return {0, {instruction.destination, static_cast<Word>(instruction.value), 0}};
+        if constexpr (std::is_same_v<T, InstructionCompareEqual>)
+            return {0, {makeOperand(instruction.leftOperand), makeOperand(instruction.rightOperand), makeTargets(instruction.ifEqual, instruction.ifNotEqual)}};
+        if constexpr (std::is_same_v<T, InstructionCompareMore>)
+            return {0, {makeOperand(instruction.leftOperand), makeOperand(instruction.rightOperand), makeTargets(instruction.ifMore, instruction.ifLess)}};
+        if constexpr (std::is_same_v<T, InstructionCompareLess>)
+            return {0, {makeOperand(instruction.leftOperand), makeOperand(instruction.rightOperand), makeTargets(instruction.ifLess, instruction.ifMore)}};
+        if constexpr (std::is_same_v<T, InstructionBranchCmp>)
+            return {static_cast<uint8_t>(instruction.type), {makeOperand(instruction.leftOperand), makeOperand(instruction.rightOperand), makeTargets(instruction.ifTrue, instruction.ifFalse)}};
+    }, instruction);
+
+    opcodes.push_back({kind, operation});
+    words.push_back(packed);
+}
+
+void BuilderIR::eraseCode(std::size_t first, std::size_t last)
+{
+    opcodes.erase(opcodes.begin() + first, opcodes.begin() + last);
+    words.erase(words.begin() + first, words.begin() + last);
 }
 
 void BuilderIR::tryOptimize()
 {
-    for(auto it = code.begin(); it < code.end() - 1; ++it)
+    auto isJump = [this](std::ptrdiff_t i) { return i >= 0 && opcodes[i].kind == Kind::Jump; };
+    auto isLabel = [this](std::ptrdiff_t i) { return i >= 0 && opcodes[i].kind == Kind::Label; };
+    // the label of a Label and the destination of a Jump
+    auto target = [this](std::ptrdiff_t i) -> LabelID& { return words[i][0]; };
+
+    for(std::ptrdiff_t i = 0; i + 1 < static_cast<std::ptrdiff_t>(opcodes.size()); ++i)
     {
-        if(std::holds_alternative<BuilderIR::InstructionJump>(*it))
+        if(isJump(i))
         {
-            auto jumpIt = it;
-            auto unreachable = std::next(jumpIt);
+            auto unreachable = i + 1;
             auto scan = unreachable;
 
-            while(scan != code.end() && !std::holds_alternative<InstructionLabel>(*scan))
+            while(scan < static_cast<std::ptrdiff_t>(opcodes.size()) && !isLabel(scan))
                 ++scan;
-            
-            if(scan != code.end() && unreachable != scan)
+
+            if(scan != static_cast<std::ptrdiff_t>(opcodes.size()) && unreachable != scan)
             {
-                code.erase(unreachable, scan);
-                it = std::prev(jumpIt);
+                eraseCode(unreachable, scan);
+                --i;
             }
         }
 
-        if(std::holds_alternative<BuilderIR::InstructionJump>(*it) && std::holds_alternative<BuilderIR::InstructionLabel>(*(it+1)))
+        if(isJump(i) && isLabel(i + 1))
         {
-            auto& jump = std::get<BuilderIR::InstructionJump>(*it);
-            auto& label = std::get<BuilderIR::InstructionLabel>(*(it+1));
-            if(jump.destination != label.label) continue;
-            
-            it = code.erase(it);
-            --it;
+            if(target(i) != target(i + 1)) continue;
+
+            eraseCode(i, i + 1);
+            --i;
             continue;
         }
 
-        if(std::holds_alternative<BuilderIR::InstructionLabel>(*it) && std::holds_alternative<BuilderIR::InstructionJump>(*(it+1)))
+        if(isLabel(i) && isJump(i + 1))
         {
-            auto& label = std::get<BuilderIR::InstructionLabel>(*it);
-            auto& jump = std::get<BuilderIR::InstructionJump>(*(it+1));
+            auto label = target(i);
+            auto destination = target(i + 1);
+            if(label != destination) continue;
 
-            if(label.label != jump.destination) continue;
+            for(std::size_t j = 0; j < opcodes.size(); ++j)
+                if(opcodes[j].kind == Kind::Jump && words[j][0] == label)
+                    words[j][0] = destination;
 
-            for(auto& instruction : code)
-            {
-                if(std::holds_alternative<BuilderIR::InstructionJump>(instruction))
-                {
-                    auto& _jump = std::get<BuilderIR::InstructionJump>(instruction);
-                    if(_jump.destination == label.label)
-                        _jump.destination = jump.destination;
-                }
-            }
-
-            code.erase(it);
-            it = code.begin();
+            eraseCode(i, i + 1);
+            i = 0;
             continue;
         }
     }
@@ -425,6 +660,7 @@ void BuilderIR::tryOptimize()
 
 BuilderIR::TempVarID BuilderIR::allocateTempVar()
 {
+    if(nextTemp == maxTempVars) throw std::runtime_error("Too many temporaries in the program");
     return nextTemp++;
 }
 
@@ -466,8 +702,14 @@ BuilderIR::InstructionBranchCmp::InstructionBranchCmp(ComparisonType type, const
 BuilderIR::InstructionLoad::InstructionLoad(TempVarID destination, const AST::VariableData &sourceVariable)
     : destination(destination), offset(sourceVariable.offset) {}
 
+BuilderIR::InstructionLoad::InstructionLoad(TempVarID destination, unsigned offset)
+    : destination(destination), offset(offset) {}
+
 BuilderIR::InstructionStore::InstructionStore(const AST::VariableData &destinationVariable, const Operand &value)
     : offset(destinationVariable.offset), value(value) {}
 
+BuilderIR::InstructionStore::InstructionStore(unsigned offset, const Operand &value)
+    : offset(offset), value(value) {}
+
 BuilderIR::InstructionDisplay::InstructionDisplay(Operand operand)
     : operand(operand) {}
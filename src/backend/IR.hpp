@@ -1,9 +1,13 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <vector>
 #include <memory>
+#include <optional>
 #include <variant>
 #include "../frontend/AST.hpp"
 #include <ostream>
@@ -31,6 +35,7 @@ public:
 
     struct InstructionLoad {
         InstructionLoad(TempVarID destination, const AST::VariableData& sourceVariable);
+        InstructionLoad(TempVarID destination, unsigned offset);
 
         TempVarID destination;
         unsigned offset;
@@ -38,6 +43,7 @@ public:
 
     struct InstructionStore {
         InstructionStore(const AST::VariableData& destinationVariable, const Operand& value);
+        InstructionStore(unsigned offset, const Operand& value);
 
         unsigned offset;
         Operand value;
@@ -175,19 +181,121 @@ public:
         InstructionBranchCmp
     >;
 
-    Operand lowerExpression(const std::unique_ptr<AST::Expression>& expression);
-    void lowerStatement(const std::unique_ptr<AST::Statement>& statement);
-    void lowerProgram(const std::vector<std::unique_ptr<AST::Statement>>& statements);
+    Operand lowerExpression(const AST::Ptr<AST::Expression>& expression);
+    void lowerStatement(const AST::Ptr<AST::Statement>& statement);
+    void lowerProgram(const std::vector<AST::Ptr<AST::Statement>>& statements);
 
     TempVarID getTempVarsCount() const;
+    LabelID getLabelsCount() const;
+
+    BuilderIR(const std::vector<AST::Ptr<AST::Statement>>& program);
+    // Empty, for a program lowered one lowerStatement at a time and then optimized
+    BuilderIR() = default;
+
+    /**
+     *  A single top-level statement lowered on its own, and a program glued together from such
+     *  fragments with their temporaries and labels renumbered. Since the control flow of a statement
+     *  never leaves it, the result is the same as lowering the whole program at once.
+     */
+    explicit BuilderIR(const AST::Ptr<AST::Statement>& statement);
+    explicit BuilderIR(const std::vector<const BuilderIR*>& fragments);
+
+    /**
+     *  The code is kept packed rather than as Instructions: one opcode and three 32-bit words per
+     *  instruction, in two arrays indexed alike, so that a pass over the code reads 14 bytes per
+     *  instruction. Which words an instruction uses, and for what, is fixed by its kind; the kinds
+     *  follow the order of the Instruction alternatives. Compare instructions, whose two labels do
+     *  not fit next to their operands, refer to an entry of the targets side table.
+     */
+    enum class Kind : uint8_t {
+        Load,               // destination temporary, variable offset
+        Store,              // variable offset, value operand
+        BinaryOperation,    // destination temporary, left operand, right operand
+        UnaryOperator,      // destination temporary, operand
+        Label,              // label
+        Jump,               // label
+        Branch,             // condition operand, label if true, label if false
+        Display,            // operand
+        Set,                // destination temporary, value
+        CompareEqual,       // left operand, right operand, targets: equal, not equal
+        CompareMore,        // left operand, right operand, targets: more, less
+        CompareLess,        // left operand, right operand, targets: less, more
+        BranchCmp           // left operand, right operand, targets: true, false
+    };
+
+    // operation is the Operation or ComparisonType of the instructions that have one
+    struct Opcode {
+        Kind kind;
+        uint8_t operation = 0;
+    };
+
+    using Word = uint32_t;
+    using Words = std::array<Word, 3>;
+
+    struct Targets {
+        LabelID first;
+        LabelID second;
+    };
+
+    std::size_t size() const;
+    Opcode getOpcode(std::size_t index) const;
+    const Words& getWords(std::size_t index) const;
+
+    /**
+     *  An operand word is tagged by its low bits: x1 holds an immediate of 31 bits, x00 a temporary
+     *  and x10 the index of an immediate too wide for that in the constants side table.
+     */
+    Operand getOperand(Word word) const;
+    const Targets& getTargets(Word word) const;
+
+    // Instructions decoded from the packed code on access, for passes written against the variant
+    class CodeView {
+    public:
+        class Iterator {
+        public:
+            using value_type = Instruction;
+            using difference_type = std::ptrdiff_t;
+
+            Iterator() = default;
+            Iterator(const BuilderIR* builderIR, std::size_t index) : builderIR(builderIR), index(index) {}
+
+            Instruction operator*() const { return builderIR->getInstruction(index); }
+            Iterator& operator++() { ++index; return *this; }
+            Iterator operator++(int) { auto previous = *this; ++index; return previous; }
+            bool operator==(const Iterator& other) const { return index == other.index; }
+
+        private:
+            const BuilderIR* builderIR = nullptr;
+            std::size_t index = 0;
+        };
+
+        explicit CodeView(const BuilderIR& builderIR) : builderIR(builderIR) {}
 
-    BuilderIR(const std::vector<std::unique_ptr<AST::Statement>>& program);
-    const std::vector<Instruction>& getCode() const;
+        Iterator begin() const { return {&builderIR, 0}; }
+        Iterator end() const { return {&builderIR, builderIR.size()}; }
+        std::size_t size() const { return builderIR.size(); }
+        bool empty() const { return builderIR.size() == 0; }
+        Instruction operator[](std::size_t index) const { return builderIR.getInstruction(index); }
+
+    private:
+        const BuilderIR& builderIR;
+    };
+
+    CodeView getCode() const;
+    Instruction getInstruction(std::size_t index) const;
+    void append(const Instruction& instruction);
 
     void tryOptimize();
 
 private:
-    std::vector<Instruction> code;
+    std::vector<Opcode> opcodes;
+    std::vector<Words> words;
+    std::vector<Targets> targets;
+    std::vector<int> constants;
+
+    Word makeOperand(const Operand& operand);
+    Word makeTargets(LabelID first, LabelID second);
+    void eraseCode(std::size_t first, std::size_t last);
 
     TempVarID nextTemp = 0;
     LabelID nextLabel = 0;
@@ -195,6 +303,42 @@ private:
     TempVarID allocateTempVar();
     LabelID allocateLabel();
 
+    /**
+     *  The walks keep the nodes still to lower on these stacks instead of recursing, so nesting is only
+     *  bounded by memory. A null statement closes an if or while after its body: it jumps back to
+     *  repeat for a while loop and places the end label.
+     */
+    struct PendingStatement {
+        const AST::Statement* statement;
+        LabelID end = 0;
+        std::optional<LabelID> repeat;
+    };
+    // An operation is pushed again under its operands, whose results are then on top of operands
+    struct PendingExpression {
+        const AST::Expression* expression;
+        bool operandsLowered;
+    };
+
+    std::vector<PendingStatement> pendingStatements;
+    std::vector<PendingExpression> pendingExpressions;
+    std::vector<Operand> operands;
+
+    Operand popOperand();
+    // Lowers body next and then closes the statement it belongs to
+    void lowerBody(const AST::Ptr<AST::Statement>& body, LabelID end, std::optional<LabelID> repeat = std::nullopt);
+
+    // One overload per node type, dispatched by AST::visit; operations take their operands from operands
+    Operand lower(const AST::LiteralValue& literal);
+    Operand lower(const AST::VariableValue& variable);
+    Operand lower(const AST::UnaryOperation& unary);
+    Operand lower(const AST::BinaryOperation& binary);
+    void lower(const AST::VariableDeclaration& letStatement);
+    void lower(const AST::VariableAssignment& assignStatement);
+    void lower(const AST::DisplayStatement& displayStatement);
+    void lower(const AST::IfStatement& ifStatement);
+    void lower(const AST::WhileStatement& whileStatement);
+    void lower(const AST::CodeBlock& codeBlock);
+
     template <class T>
     void emit(T&& instruction);
 };
@@ -202,5 +346,5 @@ private:
 template <class T>
 inline void BuilderIR::emit(T &&instruction)
 {
-    code.emplace_back(std::forward<T>(instruction));   
+    append(Instruction(std::forward<T>(instruction)));
 }
\ No newline at end of file
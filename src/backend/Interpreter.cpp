@@ -0,0 +1,388 @@
+#include "Interpreter.hpp"
+#include "JIT.hpp"
+#include <stdexcept>
+#include <unordered_map>
+#include <limits>
+#include <memory>
+
+namespace {
+    constexpr uint32_t unresolvedLabel = std::numeric_limits<uint32_t>::max();
+}
+
+struct Interpreter::Translator {
+    Interpreter& interpreter;
+    std::vector<uint32_t> labelPositions;
+
+    uint32_t operandSlot(const BuilderIR::Operand& operand) { return interpreter.getOperandSlot(operand); }
+    uint32_t tempSlot(BuilderIR::TempVarID temp) { return interpreter.getTempVarSlot(temp); }
+    uint32_t constantSlot(int64_t value) { return interpreter.getConstantSlot(value); }
+
+    void emit(Interpreter::Opcode opcode, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0)
+    {
+        interpreter.ops.push_back({opcode, a, b, c, d});
+    }
+
+    void operator()(const BuilderIR::InstructionLoad& load)
+    {
+        emit(Interpreter::Opcode::Move, tempSlot(load.destination), interpreter.getVariableSlot(load.offset));
+    }
+
+    void operator()(const BuilderIR::InstructionStore& store)
+    {
+        emit(Interpreter::Opcode::Move, interpreter.getVariableSlot(store.offset), operandSlot(store.value));
+    }
+
+    void operator()(const BuilderIR::InstructionSet& set)
+    {
+        emit(Interpreter::Opcode::Move, tempSlot(set.destination), constantSlot(set.value));
+    }
+
+    void operator()(const BuilderIR::InstructionBinaryOperation& binaryOperation)
+    {
+        auto destination = tempSlot(binaryOperation.destination);
+        auto left = operandSlot(binaryOperation.leftOperand);
+        auto right = operandSlot(binaryOperation.rightOperand);
+
+        using Operation = BuilderIR::InstructionBinaryOperation::Operation;
+        switch(binaryOperation.operation)
+        {
+            case Operation::Addition:       emit(Interpreter::Opcode::Add, destination, left, right); return;
+            case Operation::Subtraction:    emit(Interpreter::Opcode::Subtract, destination, left, right); return;
+            case Operation::Multiplication: emit(Interpreter::Opcode::Multiply, destination, left, right); return;
+            case Operation::Division:       emit(Interpreter::Opcode::Divide, destination, left, right); return;
+            case Operation::Modulo:         emit(Interpreter::Opcode::Modulo, destination, left, right); return;
+            default:
+                throw std::runtime_error("[Interpreter] Binary operation is expected to be lowered to branches");
+        }
+    }
+
+    void operator()(const BuilderIR::InstructionUnaryOperator& unaryOperation)
+    {
+        auto opcode = unaryOperation.operation == BuilderIR::InstructionUnaryOperator::Operation::Negation
+            ? Interpreter::Opcode::Negate
+            : Interpreter::Opcode::Not;
+        emit(opcode, tempSlot(unaryOperation.destination), operandSlot(unaryOperation.operand));
+    }
+
+    void operator()(const BuilderIR::InstructionLabel& label)
+    {
+        if(label.label >= labelPositions.size()) labelPositions.resize(label.label + 1, unresolvedLabel);
+        labelPositions[label.label] = interpreter.ops.size();
+    }
+
+    void operator()(const BuilderIR::InstructionJump& jump)
+    {
+        emit(Interpreter::Opcode::Jump, jump.destination);
+    }
+
+    void operator()(const BuilderIR::InstructionBranch& branch)
+    {
+        emit(Interpreter::Opcode::Branch, operandSlot(branch.condition), 0, branch.ifTrue, branch.ifFalse);
+    }
+
+    void operator()(const BuilderIR::InstructionCompareEqual& cmpEqual)
+    {
+        emit(Interpreter::Opcode::BranchEqual, operandSlot(cmpEqual.leftOperand), operandSlot(cmpEqual.rightOperand), cmpEqual.ifEqual, cmpEqual.ifNotEqual);
+    }
+
+    void operator()(const BuilderIR::InstructionCompareLess& cmpLess)
+    {
+        emit(Interpreter::Opcode::BranchLess, operandSlot(cmpLess.leftOperand), operandSlot(cmpLess.rightOperand), cmpLess.ifLess, cmpLess.ifMore);
+    }
+
+    void operator()(const BuilderIR::InstructionCompareMore& cmpMore)
+    {
+        emit(Interpreter::Opcode::BranchGreater, operandSlot(cmpMore.leftOperand), operandSlot(cmpMore.rightOperand), cmpMore.ifMore, cmpMore.ifLess);
+    }
+
+    void operator()(const BuilderIR::InstructionBranchCmp& branchCmp)
+    {
+        using ComparisonType = BuilderIR::InstructionBranchCmp::ComparisonType;
+
+        Interpreter::Opcode opcode;
+        switch(branchCmp.type)
+        {
+            case ComparisonType::Equals:        opcode = Interpreter::Opcode::BranchEqual; break;
+            case ComparisonType::NotEquals:     opcode = Interpreter::Opcode::BranchNotEqual; break;
+            case ComparisonType::Greater:       opcode = Interpreter::Opcode::BranchGreater; break;
+            case ComparisonType::GreaterEqual:  opcode = Interpreter::Opcode::BranchGreaterEqual; break;
+            case ComparisonType::Less:          opcode = Interpreter::Opcode::BranchLess; break;
+            case ComparisonType::LessEqual:     opcode = Interpreter::Opcode::BranchLessEqual; break;
+            default:
+                throw std::runtime_error("[Interpreter] Invalid comparison type");
+        }
+
+        emit(opcode, operandSlot(branchCmp.leftOperand), operandSlot(branchCmp.rightOperand), branchCmp.ifTrue, branchCmp.ifFalse);
+    }
+
+    void operator()(const BuilderIR::InstructionDisplay& display)
+    {
+        emit(Interpreter::Opcode::Display, operandSlot(display.operand));
+    }
+};
+
+namespace {
+    class OutputBuffer {
+    public:
+        OutputBuffer(std::ostream& os, bool lineBuffered) : os(os), lineBuffered(lineBuffered) {}
+        ~OutputBuffer() { flush(); }
+
+        void display(int64_t value)
+        {
+            if(size + maxLineLength > capacity) flush();
+
+            char digits[maxLineLength];
+            char* end = digits + maxLineLength;
+            char* it = end;
+
+            *--it = '\n';
+            uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+            do
+            {
+                *--it = static_cast<char>('0' + magnitude % 10);
+                magnitude /= 10;
+            } while(magnitude);
+            if(value < 0) *--it = '-';
+
+            while(it != end) buffer[size++] = *it++;
+            if(lineBuffered) flush();
+        }
+
+        void flush()
+        {
+            os.write(buffer, size);
+            if(lineBuffered) os.flush();
+            size = 0;
+        }
+
+    private:
+        static constexpr std::size_t capacity = 1 << 16;
+        static constexpr std::size_t maxLineLength = 24;
+
+        std::ostream& os;
+        const bool lineBuffered;
+        char buffer[capacity];
+        std::size_t size = 0;
+    };
+}
+
+Interpreter::Interpreter(const BuilderIR &builderIR, const SymbolTable &symbolTable)
+    : variablesCount(symbolTable.getOffset() / 8), tempVarsCount(builderIR.getTempVarsCount())
+{
+    translate(builderIR);
+}
+
+const std::vector<Interpreter::Op> &Interpreter::getOps() const
+{
+    return ops;
+}
+
+std::size_t Interpreter::getFrameSize() const
+{
+    return variablesCount + tempVarsCount + constants.size();
+}
+
+void Interpreter::setLineBuffered(bool lineBuffered)
+{
+    this->lineBuffered = lineBuffered;
+}
+
+uint32_t Interpreter::getVariableSlot(unsigned offset) const
+{
+    // variables are placed at [rbp - offset] with offsets 8, 16, ..., so slot 0 holds offset 8
+    return offset / 8 - 1;
+}
+
+bool Interpreter::isConstantSlot(uint32_t slot) const
+{
+    return slot >= variablesCount + tempVarsCount;
+}
+
+int64_t Interpreter::getConstant(uint32_t slot) const
+{
+    return constants.at(slot - variablesCount - tempVarsCount);
+}
+
+void Interpreter::displayFromNative(void *output, int64_t value)
+{
+    static_cast<OutputBuffer*>(output)->display(value);
+}
+
+uint32_t Interpreter::getTempVarSlot(BuilderIR::TempVarID temp) const
+{
+    return variablesCount + temp;
+}
+
+uint32_t Interpreter::getOperandSlot(const BuilderIR::Operand &operand)
+{
+    switch(operand.type)
+    {
+        case BuilderIR::Operand::Type::Immediate:
+            return getConstantSlot(operand.immediate);
+        case BuilderIR::Operand::Type::Temporary:
+            return getTempVarSlot(operand.tempVar);
+        default:
+            throw std::runtime_error("[Interpreter] Invalid operand type");
+    }
+}
+
+uint32_t Interpreter::getConstantSlot(int64_t value)
+{
+    auto [it, inserted] = constantSlots.try_emplace(value, variablesCount + tempVarsCount + constants.size());
+    if(inserted) constants.push_back(value);
+    return it->second;
+}
+
+void Interpreter::translate(const BuilderIR &builderIR)
+{
+    Translator translator{*this, {}};
+    for(auto instruction : builderIR.getCode())
+        std::visit(translator, instruction);
+    ops.push_back({Opcode::Halt});
+
+    auto& labelPositions = translator.labelPositions;
+    auto resolve = [&labelPositions](uint32_t label) -> uint32_t {
+        if(label >= labelPositions.size() || labelPositions[label] == unresolvedLabel)
+            throw std::runtime_error("[Interpreter] Jump to undefined label");
+        return labelPositions[label];
+    };
+
+    for(std::size_t i = 0; i < ops.size(); ++i)
+    {
+        auto& op = ops[i];
+        switch(op.opcode)
+        {
+            case Opcode::Jump: {
+                op.a = resolve(op.a);
+                if(op.a > i) break;
+
+                op.opcode = Opcode::LoopBack;
+                op.b = loopsCount++;
+            } break;
+            case Opcode::Branch:
+            case Opcode::BranchEqual:
+            case Opcode::BranchNotEqual:
+            case Opcode::BranchLess:
+            case Opcode::BranchLessEqual:
+            case Opcode::BranchGreater:
+            case Opcode::BranchGreaterEqual: {
+                op.c = resolve(op.c);
+                op.d = resolve(op.d);
+            } break;
+            default:
+                break;
+        }
+    }
+}
+
+void Interpreter::run(std::ostream &os, JIT* jit)
+{
+    struct Loop {
+        uint32_t iterations = 0;
+        JIT::NativeLoop native = nullptr;
+        bool rejected = false;
+    };
+    std::vector<Loop> loops(loopsCount);
+
+    std::vector<int64_t> frame(getFrameSize(), 0);
+    std::copy(constants.begin(), constants.end(), frame.begin() + variablesCount + tempVarsCount);
+
+    auto output = std::make_unique<OutputBuffer>(os, lineBuffered);
+
+    int64_t* slots = frame.data();
+    const Op* code = ops.data();
+    const Op* pc = code;
+
+    // Arithmetic is carried out on unsigned values so that overflow wraps like on the native target
+    auto wrap = [](uint64_t value) { return static_cast<int64_t>(value); };
+
+#if defined(__GNUC__)
+    static const void* dispatchTable[] = {
+        &&Move, &&Add, &&Subtract, &&Multiply, &&Divide, &&Modulo, &&Negate, &&Not, &&Jump, &&LoopBack, &&Branch,
+        &&BranchEqual, &&BranchNotEqual, &&BranchLess, &&BranchLessEqual, &&BranchGreater, &&BranchGreaterEqual,
+        &&Display, &&Halt
+    };
+    #define LING_CASE(name) name:
+    #define LING_DISPATCH() goto *dispatchTable[static_cast<uint8_t>(pc->opcode)]
+    #define LING_NEXT() do { ++pc; LING_DISPATCH(); } while(0)
+    #define LING_JUMP(target) do { pc = code + (target); LING_DISPATCH(); } while(0)
+
+    LING_DISPATCH();
+#else
+    #define LING_CASE(name) case Opcode::name:
+    #define LING_NEXT() do { ++pc; continue; } while(0)
+    #define LING_JUMP(target) do { pc = code + (target); continue; } while(0)
+
+    for(;;) switch(pc->opcode) {
+#endif
+
+    LING_CASE(Move)
+        slots[pc->a] = slots[pc->b];
+        LING_NEXT();
+    LING_CASE(Add)
+        slots[pc->a] = wrap(static_cast<uint64_t>(slots[pc->b]) + static_cast<uint64_t>(slots[pc->c]));
+        LING_NEXT();
+    LING_CASE(Subtract)
+        slots[pc->a] = wrap(static_cast<uint64_t>(slots[pc->b]) - static_cast<uint64_t>(slots[pc->c]));
+        LING_NEXT();
+    LING_CASE(Multiply)
+        slots[pc->a] = wrap(static_cast<uint64_t>(slots[pc->b]) * static_cast<uint64_t>(slots[pc->c]));
+        LING_NEXT();
+    LING_CASE(Divide)
+        if(slots[pc->c] == 0) throw std::runtime_error("[Interpreter] Division by zero");
+        slots[pc->a] = slots[pc->c] == -1 ? wrap(0 - static_cast<uint64_t>(slots[pc->b])) : slots[pc->b] / slots[pc->c];
+        LING_NEXT();
+    LING_CASE(Modulo)
+        if(slots[pc->c] == 0) throw std::runtime_error("[Interpreter] Division by zero");
+        slots[pc->a] = slots[pc->c] == -1 ? 0 : slots[pc->b] % slots[pc->c];
+        LING_NEXT();
+    LING_CASE(Negate)
+        slots[pc->a] = wrap(0 - static_cast<uint64_t>(slots[pc->b]));
+        LING_NEXT();
+    LING_CASE(Not)
+        slots[pc->a] = !slots[pc->b];
+        LING_NEXT();
+    LING_CASE(Jump)
+        LING_JUMP(pc->a);
+    LING_CASE(LoopBack)
+        if(jit)
+        {
+            auto& loop = loops[pc->b];
+            if(!loop.native && !loop.rejected && ++loop.iterations >= jit->getThreshold())
+            {
+                loop.native = jit->compileLoop(*this, pc->a, pc - code, loop.iterations);
+                loop.rejected = !loop.native;
+            }
+            if(loop.native)
+                LING_JUMP(loop.native(slots, output.get()));
+        }
+        LING_JUMP(pc->a);
+    LING_CASE(Branch)
+        LING_JUMP(slots[pc->a] ? pc->c : pc->d);
+    LING_CASE(BranchEqual)
+        LING_JUMP(slots[pc->a] == slots[pc->b] ? pc->c : pc->d);
+    LING_CASE(BranchNotEqual)
+        LING_JUMP(slots[pc->a] != slots[pc->b] ? pc->c : pc->d);
+    LING_CASE(BranchLess)
+        LING_JUMP(slots[pc->a] < slots[pc->b] ? pc->c : pc->d);
+    LING_CASE(BranchLessEqual)
+        LING_JUMP(slots[pc->a] <= slots[pc->b] ? pc->c : pc->d);
+    LING_CASE(BranchGreater)
+        LING_JUMP(slots[pc->a] > slots[pc->b] ? pc->c : pc->d);
+    LING_CASE(BranchGreaterEqual)
+        LING_JUMP(slots[pc->a] >= slots[pc->b] ? pc->c : pc->d);
+    LING_CASE(Display)
+        output->display(slots[pc->a]);
+        LING_NEXT();
+    LING_CASE(Halt)
+        return;
+
+#if !defined(__GNUC__)
+    }
+#endif
+
+    #undef LING_CASE
+    #undef LING_DISPATCH
+    #undef LING_NEXT
+    #undef LING_JUMP
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "IR.hpp"
+#include "SymbolTable.hpp"
+
+class JIT;
+
+/**
+ *  Register-based virtual machine executing BuilderIR without the native toolchain.
+ *
+ *  The IR is translated once into a pre-decoded form in which every operand is an index
+ *  into a single flat int64_t frame laid out as [variables | temporaries | constants]
+ *  and every label is resolved to an instruction index. Immediates are materialized as
+ *  constant slots, so each handler only ever reads and writes frame slots.
+ *
+ *  Backward jumps are translated into LoopBack ops carrying a per-loop counter. When a JIT
+ *  is passed to run(), loops crossing its threshold are compiled to native code and entered
+ *  on the spot, sharing the frame with the interpreter.
+ */
+class Interpreter {
+public:
+    Interpreter(const BuilderIR& builderIR, const SymbolTable& symbolTable);
+
+    void run(std::ostream& os, JIT* jit = nullptr);
+    void setLineBuffered(bool lineBuffered);
+
+    enum class Opcode : uint8_t {
+        Move,
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Modulo,
+        Negate,
+        Not,
+        Jump,
+        LoopBack,
+        Branch,
+        BranchEqual,
+        BranchNotEqual,
+        BranchLess,
+        BranchLessEqual,
+        BranchGreater,
+        BranchGreaterEqual,
+        Display,
+        Halt
+    };
+
+    struct Op {
+        Opcode opcode;
+        uint32_t a = 0;
+        uint32_t b = 0;
+        uint32_t c = 0;
+        uint32_t d = 0;
+    };
+
+    const std::vector<Op>& getOps() const;
+    std::size_t getFrameSize() const;
+    uint32_t getVariableSlot(unsigned offset) const;
+
+    bool isConstantSlot(uint32_t slot) const;
+    int64_t getConstant(uint32_t slot) const;
+
+    // Entry point used by native code to append a displayed value to the interpreter's output
+    static void displayFromNative(void* output, int64_t value);
+
+private:
+    struct Translator;
+
+    std::vector<Op> ops;
+    std::vector<int64_t> constants;
+    std::unordered_map<int64_t, uint32_t> constantSlots;
+    uint32_t loopsCount = 0;
+    bool lineBuffered = false;
+
+    uint32_t variablesCount;
+    uint32_t tempVarsCount;
+
+    uint32_t getTempVarSlot(BuilderIR::TempVarID temp) const;
+    uint32_t getOperandSlot(const BuilderIR::Operand& operand);
+    uint32_t getConstantSlot(int64_t value);
+
+    void translate(const BuilderIR& builderIR);
+};
@@ -0,0 +1,473 @@
+#include "JIT.hpp"
+#include "Interpreter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <map>
+
+#if defined(__x86_64__) && defined(__linux__)
+    #define LING_JIT_SUPPORTED 1
+    #include <sys/mman.h>
+    #include <unistd.h>
+#else
+    #define LING_JIT_SUPPORTED 0
+#endif
+
+namespace {
+    enum Register : uint8_t {
+        rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+        r8, r9, r10, r11, r12, r13, r14, r15
+    };
+
+    enum Condition : uint8_t {
+        Equal = 0x4,
+        NotEqual = 0x5,
+        Less = 0xC,
+        GreaterEqual = 0xD,
+        LessEqual = 0xE,
+        Greater = 0xF
+    };
+
+    constexpr Register frameRegister = rbx;
+    constexpr Register outputRegister = r12;
+    constexpr Register cachedRegisters[] = { r13, r14, r15, rbp };
+    constexpr Register savedRegisters[] = { rbx, r12, r13, r14, r15, rbp };
+
+    struct Assembler {
+        std::vector<uint8_t> bytes;
+
+        std::size_t position() const { return bytes.size(); }
+
+        void byte(uint8_t value) { bytes.push_back(value); }
+
+        void imm32(int32_t value)
+        {
+            uint8_t raw[4];
+            std::memcpy(raw, &value, 4);
+            bytes.insert(bytes.end(), raw, raw + 4);
+        }
+
+        void imm64(int64_t value)
+        {
+            uint8_t raw[8];
+            std::memcpy(raw, &value, 8);
+            bytes.insert(bytes.end(), raw, raw + 8);
+        }
+
+        void patch32(std::size_t at, int32_t value)
+        {
+            std::memcpy(bytes.data() + at, &value, 4);
+        }
+
+        void rex(uint8_t reg, uint8_t rm)
+        {
+            byte(0x48 | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0));
+        }
+
+        void regReg(std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t rm)
+        {
+            rex(reg, rm);
+            for(auto value : opcode) byte(value);
+            byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+        }
+
+        // [rbx + disp32] addressing of a frame slot
+        void regFrame(std::initializer_list<uint8_t> opcode, uint8_t reg, int32_t displacement)
+        {
+            rex(reg, frameRegister);
+            for(auto value : opcode) byte(value);
+            byte(0x80 | (reg & 7) << 3 | frameRegister);
+            imm32(displacement);
+        }
+
+        void mov(Register destination, Register source) { if(destination != source) regReg({0x89}, source, destination); }
+        void load(Register destination, int32_t displacement) { regFrame({0x8B}, destination, displacement); }
+        void store(int32_t displacement, Register source) { regFrame({0x89}, source, displacement); }
+
+        void movImmediate(Register destination, int64_t value)
+        {
+            if(value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max())
+            {
+                regReg({0xC7}, 0, destination);
+                imm32(static_cast<int32_t>(value));
+                return;
+            }
+            rex(0, destination);
+            byte(0xB8 + (destination & 7));
+            imm64(value);
+        }
+
+        void add(Register destination, Register source) { regReg({0x01}, source, destination); }
+        void sub(Register destination, Register source) { regReg({0x29}, source, destination); }
+        void imul(Register destination, Register source) { regReg({0x0F, 0xAF}, destination, source); }
+        void cmp(Register left, Register right) { regReg({0x39}, right, left); }
+        void test(Register reg) { regReg({0x85}, reg, reg); }
+        void neg(Register reg) { regReg({0xF7}, 3, reg); }
+        void idiv(Register reg) { regReg({0xF7}, 7, reg); }
+        void cqo() { byte(0x48); byte(0x99); }
+
+        void cmpMinusOne(Register reg)
+        {
+            regReg({0x83}, 7, reg);
+            byte(0xFF);
+        }
+
+        // sete al; movzx eax, al
+        void setEqualToRax()
+        {
+            byte(0x0F); byte(0x94); byte(0xC0);
+            byte(0x0F); byte(0xB6); byte(0xC0);
+        }
+
+        std::size_t jcc(Condition condition)
+        {
+            byte(0x0F);
+            byte(0x80 | condition);
+            imm32(0);
+            return position() - 4;
+        }
+
+        std::size_t jmp()
+        {
+            byte(0xE9);
+            imm32(0);
+            return position() - 4;
+        }
+
+        void push(Register reg)
+        {
+            if(reg & 8) byte(0x41);
+            byte(0x50 + (reg & 7));
+        }
+
+        void pop(Register reg)
+        {
+            if(reg & 8) byte(0x41);
+            byte(0x58 + (reg & 7));
+        }
+
+        void callRax() { byte(0xFF); byte(0xD0); }
+        void movEaxImmediate(uint32_t value) { byte(0xB8); imm32(static_cast<int32_t>(value)); }
+        void alignStack() { byte(0x48); byte(0x83); byte(0xEC); byte(0x08); }
+        void unalignStack() { byte(0x48); byte(0x83); byte(0xC4); byte(0x08); }
+        void ret() { byte(0xC3); }
+    };
+
+    class LoopCompiler {
+    public:
+        LoopCompiler(const Interpreter& interpreter, uint32_t begin, uint32_t end)
+            : interpreter(interpreter), ops(interpreter.getOps()), begin(begin), end(end) {}
+
+        std::vector<uint8_t> compile()
+        {
+            allocateRegisters();
+
+            for(auto reg : savedRegisters) as.push(reg);
+            as.alignStack();
+            as.mov(frameRegister, rdi);
+            as.mov(outputRegister, rsi);
+            for(auto& [slot, reg] : cached) as.load(reg, displacement(slot));
+
+            std::vector<std::size_t> opPositions(end - begin + 1);
+            for(uint32_t i = begin; i <= end; ++i)
+            {
+                opPositions[i - begin] = as.position();
+                compileOp(i);
+            }
+
+            std::map<uint32_t, std::size_t> exitStubs;
+            for(auto& [at, target] : exits)
+            {
+                auto [it, inserted] = exitStubs.try_emplace(target, as.position());
+                if(inserted)
+                {
+                    as.movEaxImmediate(target);
+                    leaveFixups.push_back(as.jmp());
+                }
+                as.patch32(at, it->second - (at + 4));
+            }
+            for(auto& [at, target] : jumps)
+                as.patch32(at, opPositions[target - begin] - (at + 4));
+
+            auto leave = as.position();
+            for(auto at : leaveFixups) as.patch32(at, leave - (at + 4));
+            for(auto& [slot, reg] : cached) as.store(displacement(slot), reg);
+            as.unalignStack();
+            for(auto it = std::rbegin(savedRegisters); it != std::rend(savedRegisters); ++it) as.pop(*it);
+            as.ret();
+
+            return std::move(as.bytes);
+        }
+
+    private:
+        const Interpreter& interpreter;
+        const std::vector<Interpreter::Op>& ops;
+        const uint32_t begin;
+        const uint32_t end;
+
+        Assembler as;
+        std::vector<std::pair<uint32_t, Register>> cached;
+        std::vector<std::pair<std::size_t, uint32_t>> jumps;
+        std::vector<std::pair<std::size_t, uint32_t>> exits;
+        std::vector<std::size_t> leaveFixups;
+
+        static int32_t displacement(uint32_t slot)
+        {
+            return static_cast<int32_t>(slot * 8);
+        }
+
+        void allocateRegisters()
+        {
+            std::map<uint32_t, unsigned> uses;
+            auto use = [this, &uses](uint32_t slot) { if(!interpreter.isConstantSlot(slot)) ++uses[slot]; };
+
+            for(uint32_t i = begin; i <= end; ++i)
+            {
+                auto& op = ops[i];
+                switch(op.opcode)
+                {
+                    case Interpreter::Opcode::Add:
+                    case Interpreter::Opcode::Subtract:
+                    case Interpreter::Opcode::Multiply:
+                    case Interpreter::Opcode::Divide:
+                    case Interpreter::Opcode::Modulo:
+                        use(op.a); use(op.b); use(op.c);
+                        break;
+                    case Interpreter::Opcode::Move:
+                    case Interpreter::Opcode::Negate:
+                    case Interpreter::Opcode::Not:
+                    case Interpreter::Opcode::BranchEqual:
+                    case Interpreter::Opcode::BranchNotEqual:
+                    case Interpreter::Opcode::BranchLess:
+                    case Interpreter::Opcode::BranchLessEqual:
+                    case Interpreter::Opcode::BranchGreater:
+                    case Interpreter::Opcode::BranchGreaterEqual:
+                        use(op.a); use(op.b);
+                        break;
+                    case Interpreter::Opcode::Branch:
+                    case Interpreter::Opcode::Display:
+                        use(op.a);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            std::vector<std::pair<uint32_t, unsigned>> candidates(uses.begin(), uses.end());
+            std::stable_sort(candidates.begin(), candidates.end(), [](auto& a, auto& b) { return a.second > b.second; });
+
+            for(std::size_t i = 0; i < candidates.size() && i < std::size(cachedRegisters); ++i)
+            {
+                if(candidates[i].second < 2) break;
+                cached.emplace_back(candidates[i].first, cachedRegisters[i]);
+            }
+        }
+
+        const Register* findCached(uint32_t slot) const
+        {
+            for(auto& [cachedSlot, reg] : cached)
+                if(cachedSlot == slot) return &reg;
+            return nullptr;
+        }
+
+        // Returns the register holding the slot's value, materializing it into scratch if needed
+        Register operand(uint32_t slot, Register scratch)
+        {
+            if(auto* reg = findCached(slot)) return *reg;
+
+            if(interpreter.isConstantSlot(slot)) as.movImmediate(scratch, interpreter.getConstant(slot));
+            else as.load(scratch, displacement(slot));
+            return scratch;
+        }
+
+        void loadInto(Register destination, uint32_t slot)
+        {
+            as.mov(destination, operand(slot, destination));
+        }
+
+        void storeFrom(uint32_t slot, Register source)
+        {
+            if(auto* reg = findCached(slot)) as.mov(*reg, source);
+            else as.store(displacement(slot), source);
+        }
+
+        void branchTo(std::size_t at, uint32_t target)
+        {
+            if(target >= begin && target <= end) jumps.emplace_back(at, target);
+            else exits.emplace_back(at, target);
+        }
+
+        void conditionalBranch(Condition condition, const Interpreter::Op& op)
+        {
+            branchTo(as.jcc(condition), op.c);
+            branchTo(as.jmp(), op.d);
+        }
+
+        void compileOp(uint32_t index)
+        {
+            auto& op = ops[index];
+            switch(op.opcode)
+            {
+                case Interpreter::Opcode::Move: {
+                    storeFrom(op.a, operand(op.b, rax));
+                } break;
+                case Interpreter::Opcode::Add: {
+                    loadInto(rax, op.b);
+                    as.add(rax, operand(op.c, rcx));
+                    storeFrom(op.a, rax);
+                } break;
+                case Interpreter::Opcode::Subtract: {
+                    loadInto(rax, op.b);
+                    as.sub(rax, operand(op.c, rcx));
+                    storeFrom(op.a, rax);
+                } break;
+                case Interpreter::Opcode::Multiply: {
+                    loadInto(rax, op.b);
+                    as.imul(rax, operand(op.c, rcx));
+                    storeFrom(op.a, rax);
+                } break;
+                case Interpreter::Opcode::Divide:
+                case Interpreter::Opcode::Modulo: {
+                    // zero and -1 divisors trap or overflow in idiv, the interpreter handles them instead
+                    loadInto(rcx, op.c);
+                    as.test(rcx);
+                    exits.emplace_back(as.jcc(Equal), index);
+                    as.cmpMinusOne(rcx);
+                    exits.emplace_back(as.jcc(Equal), index);
+                    loadInto(rax, op.b);
+                    as.cqo();
+                    as.idiv(rcx);
+                    storeFrom(op.a, op.opcode == Interpreter::Opcode::Divide ? rax : rdx);
+                } break;
+                case Interpreter::Opcode::Negate: {
+                    loadInto(rax, op.b);
+                    as.neg(rax);
+                    storeFrom(op.a, rax);
+                } break;
+                case Interpreter::Opcode::Not: {
+                    as.test(operand(op.b, rax));
+                    as.setEqualToRax();
+                    storeFrom(op.a, rax);
+                } break;
+                case Interpreter::Opcode::Jump:
+                case Interpreter::Opcode::LoopBack: {
+                    branchTo(as.jmp(), op.a);
+                } break;
+                case Interpreter::Opcode::Branch: {
+                    as.test(operand(op.a, rax));
+                    conditionalBranch(NotEqual, op);
+                } break;
+                case Interpreter::Opcode::BranchEqual:
+                case Interpreter::Opcode::BranchNotEqual:
+                case Interpreter::Opcode::BranchLess:
+                case Interpreter::Opcode::BranchLessEqual:
+                case Interpreter::Opcode::BranchGreater:
+                case Interpreter::Opcode::BranchGreaterEqual: {
+                    auto left = operand(op.a, rax);
+                    auto right = operand(op.b, rcx);
+                    as.cmp(left, right);
+                    conditionalBranch(getCondition(op.opcode), op);
+                } break;
+                case Interpreter::Opcode::Display: {
+                    loadInto(rsi, op.a);
+                    as.mov(rdi, outputRegister);
+                    as.movImmediate(rax, reinterpret_cast<int64_t>(&Interpreter::displayFromNative));
+                    as.callRax();
+                } break;
+                default: {
+                    exits.emplace_back(as.jmp(), index);
+                } break;
+            }
+        }
+
+        static Condition getCondition(Interpreter::Opcode opcode)
+        {
+            switch(opcode)
+            {
+                case Interpreter::Opcode::BranchEqual:          return Equal;
+                case Interpreter::Opcode::BranchNotEqual:       return NotEqual;
+                case Interpreter::Opcode::BranchLess:           return Less;
+                case Interpreter::Opcode::BranchLessEqual:      return LessEqual;
+                case Interpreter::Opcode::BranchGreater:        return Greater;
+                case Interpreter::Opcode::BranchGreaterEqual:   return GreaterEqual;
+                default:
+                    throw std::runtime_error("[JIT] Opcode is not a comparison");
+            }
+        }
+    };
+}
+
+JIT::JIT(uint32_t threshold)
+    : threshold(threshold) {}
+
+JIT::~JIT()
+{
+#if LING_JIT_SUPPORTED
+    for(auto& mapping : mappings)
+        munmap(mapping.address, mapping.size);
+#endif
+}
+
+uint32_t JIT::getThreshold() const
+{
+    return threshold;
+}
+
+bool JIT::isSupported()
+{
+    return LING_JIT_SUPPORTED;
+}
+
+JIT::NativeLoop JIT::compileLoop(const Interpreter &interpreter, uint32_t begin, uint32_t end, uint32_t iterations)
+{
+#if LING_JIT_SUPPORTED
+    // frame slots are addressed with a 32-bit displacement
+    if(interpreter.getFrameSize() > std::numeric_limits<int32_t>::max() / 8) return nullptr;
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto code = LoopCompiler(interpreter, begin, end).compile();
+
+    std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    std::size_t size = (code.size() + pageSize - 1) / pageSize * pageSize;
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(address == MAP_FAILED) return nullptr;
+
+    std::memcpy(address, code.data(), code.size());
+    if(mprotect(address, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(address, size);
+        return nullptr;
+    }
+    mappings.push_back({address, size});
+
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    events.push_back({begin, end, iterations, code.size(), elapsed.count()});
+
+    return reinterpret_cast<NativeLoop>(address);
+#else
+    return nullptr;
+#endif
+}
+
+const std::vector<JIT::TierUpEvent> &JIT::getEvents() const
+{
+    return events;
+}
+
+void JIT::printStats(std::ostream &os) const
+{
+    double total = 0;
+    for(auto& event : events) total += event.compileMicroseconds;
+
+    os << "[tiering] " << events.size() << " loop(s) tiered up (threshold " << threshold << "), total compile time " << total << "us\n";
+    for(auto& event : events)
+    {
+        os << "[tiering]   ops " << event.loopBegin << ".." << event.loopEnd << " after " << event.iterations
+           << " iterations: " << event.codeSize << " bytes in " << event.compileMicroseconds << "us\n";
+    }
+    if(!isSupported())
+        os << "[tiering] native loop compilation is not supported on this platform\n";
+}
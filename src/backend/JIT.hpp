@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+class Interpreter;
+
+/**
+ *  Optimizing x86-64 compiler for hot interpreter loops.
+ *
+ *  A loop is the range of interpreter ops between a LoopBack op and its target. The compiled
+ *  function is entered through on-stack replacement at the loop header: it receives the
+ *  interpreter frame, loads the most used slots into callee-saved registers, and returns the
+ *  index of the op at which the interpreter should resume after storing them back. Ops that
+ *  cannot be handled natively (division traps) also exit to the interpreter before executing.
+ */
+class JIT {
+public:
+    using NativeLoop = uint32_t (*)(int64_t* frame, void* output);
+
+    struct TierUpEvent {
+        uint32_t loopBegin;
+        uint32_t loopEnd;
+        uint32_t iterations;
+        std::size_t codeSize;
+        double compileMicroseconds;
+    };
+
+    explicit JIT(uint32_t threshold = 1000);
+    ~JIT();
+
+    JIT(const JIT&) = delete;
+    JIT& operator=(const JIT&) = delete;
+
+    uint32_t getThreshold() const;
+
+    NativeLoop compileLoop(const Interpreter& interpreter, uint32_t begin, uint32_t end, uint32_t iterations);
+
+    const std::vector<TierUpEvent>& getEvents() const;
+    void printStats(std::ostream& os) const;
+
+    static bool isSupported();
+
+private:
+    struct Mapping {
+        void* address;
+        std::size_t size;
+    };
+
+    uint32_t threshold;
+    std::vector<Mapping> mappings;
+    std::vector<TierUpEvent> events;
+};
@@ -1,11 +1,12 @@
 #include "SymbolTable.hpp"
+#include <algorithm>
 #include <sstream>
 
-SymbolTable::SymbolTable(const std::vector<std::unique_ptr<AST::Statement>> &statements)
+SymbolTable::SymbolTable(const std::vector<AST::Ptr<AST::Statement>> &statements)
 {
     for(const auto& statement : statements)
     {
-        validateStatement(statement);
+        validateTopLevel(statement);
     }
 }
 
@@ -14,124 +15,223 @@ unsigned SymbolTable::getOffset() const
     return maxOffset;
 }
 
+unsigned SymbolTable::validateTopLevel(const AST::Ptr<AST::Statement> &statement)
+{
+    if(scopes.empty()) enterScope();
+
+    auto savedMaxOffset = maxOffset;
+    maxOffset = currentOffset;
+    validateStatement(statement);
+
+    auto statementMaxOffset = maxOffset;
+    maxOffset = std::max(savedMaxOffset, statementMaxOffset);
+    return statementMaxOffset;
+}
+
+void SymbolTable::replayTopLevel(const AST::Ptr<AST::Statement> &statement, unsigned statementMaxOffset)
+{
+    if(scopes.empty()) enterScope();
+
+    // only a declaration reached without entering a block lands in the top-level scope
+    auto* current = statement.get();
+    for(;;)
+    {
+        if(current->kind == AST::Statement::Kind::If) current = static_cast<AST::IfStatement*>(current)->body.get();
+        else if(current->kind == AST::Statement::Kind::While) current = static_cast<AST::WhileStatement*>(current)->body.get();
+        else break;
+    }
+    if(current->kind == AST::Statement::Kind::VariableDeclaration)
+        declare(*static_cast<AST::VariableDeclaration*>(current));
+
+    maxOffset = std::max(maxOffset, statementMaxOffset);
+}
+
+uint64_t SymbolTable::getFingerprint() const
+{
+    return fingerprint;
+}
+
 void SymbolTable::enterScope()
 {
-    Scope scope;
-    scope.savedOffset = currentOffset;
-    scopes.push_back(std::move(scope));
+    scopes.push_back({static_cast<uint32_t>(declarations.size()), currentOffset});
 }
 
 void SymbolTable::leaveScope()
 {
     if(scopes.empty()) throw std::runtime_error("[Symbol table] Trying to leave scope that was not entered");
+
+    while(declarations.size() > scopes.back().firstDeclaration)
+    {
+        auto& declaration = declarations.back();
+        findSlot(declaration.symbol)->declaration = declaration.shadowed;
+        declarations.pop_back();
+    }
+
     currentOffset = scopes.back().savedOffset;
     scopes.pop_back();
 }
 
+SymbolTable::Slot* SymbolTable::findSlot(uint32_t symbol)
+{
+    auto mask = visible.size() - 1;
+    for(auto i = (symbol * 2654435769u) & mask;; i = (i + 1) & mask)
+    {
+        if(visible[i].symbol == symbol) return &visible[i];
+        if(visible[i].symbol == 0) return nullptr;
+    }
+}
+
+SymbolTable::Slot& SymbolTable::claimSlot(uint32_t symbol)
+{
+    if(auto* slot = findSlot(symbol)) return *slot;
+
+    if(2 * (usedSlots + 1) > visible.size())
+    {
+        std::vector<Slot> previous(2 * visible.size());
+        previous.swap(visible);
+        usedSlots = 0;
+        for(auto& slot : previous)
+            if(slot.symbol != 0) claimSlot(slot.symbol).declaration = slot.declaration;
+    }
+
+    auto mask = visible.size() - 1;
+    auto i = (symbol * 2654435769u) & mask;
+    while(visible[i].symbol != 0) i = (i + 1) & mask;
+
+    ++usedSlots;
+    visible[i].symbol = symbol;
+    return visible[i];
+}
+
 void SymbolTable::declare(AST::VariableData &variable)
 {
     if(scopes.empty()) enterScope();
 
-    auto name = variable.getName();
-    auto& top = scopes.back();
-    if(top.symbols.find(name) != top.symbols.end()) 
+    auto symbol = variable.getSymbol();
+    auto& slot = claimSlot(symbol);
+    if(slot.declaration != none && slot.declaration >= scopes.back().firstDeclaration) 
     {
         std::ostringstream oss;
-        oss << "Double variable declaration\n" << variable.token << "\nFirst declared\n" << getDeclarationInfo(variable).declarationToken;
+        oss << "Double variable declaration\n" << variable.token << "\nFirst declared\n" << declarations[slot.declaration].token;
         throw std::runtime_error(oss.str());
     }
 
     currentOffset += 8;
 
     variable.resolve(currentOffset);
-    top.symbols.emplace(name, Scope::DeclarationInfo(currentOffset, variable.token));
+    declarations.push_back({symbol, currentOffset, slot.declaration, variable.token});
+    slot.declaration = declarations.size() - 1;
     if(maxOffset < currentOffset) maxOffset = currentOffset;
+
+    if(scopes.size() == 1)
+    {
+        // symbols stay the same for the whole run, so they stand in for the spelling
+        for(uint64_t value : {static_cast<uint64_t>(symbol), static_cast<uint64_t>(currentOffset)})
+        {
+            fingerprint ^= value;
+            fingerprint *= 0x100000001b3ull;
+        }
+    }
 }
 
 void SymbolTable::resolve(AST::VariableData &variable)
 {
     if(scopes.empty()) throw std::runtime_error("[Symbol table] Trying to use variable without scope");
 
-    auto symbolOffset = getDeclarationInfo(variable).offset;
-    variable.resolve(symbolOffset);
+    variable.resolve(getDeclaration(variable).offset);
 }
 
-bool SymbolTable::validateStatement(const std::unique_ptr<AST::Statement> &statement)
+void SymbolTable::validateStatement(const AST::Ptr<AST::Statement> &statement)
 {
-    if(auto* ptr = dynamic_cast<AST::VariableDeclaration*>(statement.get())) {
-        auto& variableData = *dynamic_cast<AST::VariableData*>(ptr);
-        auto& expression = ptr->value;
-        if(!validateExpression(expression)) return false;
-        declare(variableData);
-        return true;
+    pendingStatements.clear();
+    pendingStatements.push_back(statement.get());
+    while(!pendingStatements.empty())
+    {
+        auto* next = pendingStatements.back();
+        pendingStatements.pop_back();
+        if(next) AST::visit([this](auto& node) { validate(node); }, *next);
+        else leaveScope();
     }
-    if(auto* ptr = dynamic_cast<AST::VariableAssignment*>(statement.get())) {
-        auto& variableData = *dynamic_cast<AST::VariableData*>(ptr);
-        resolve(variableData);
+}
 
-        auto& expression = ptr->value;
-        return validateExpression(expression);
-    }
-    if(auto* ptr = dynamic_cast<AST::IfStatement*>(statement.get())) {
-        auto& condition = ptr->condition;
-        auto& body = ptr->body;
-        return validateExpression(condition) && validateStatement(body);
-    }
-    if(auto* ptr = dynamic_cast<AST::WhileStatement*>(statement.get())) {
-        auto& condition = ptr->condition;
-        auto& body = ptr->body;
-        return validateExpression(condition) && validateStatement(body);
-    }
-    if(auto* ptr = dynamic_cast<AST::DisplayStatement*>(statement.get())) {
-        auto& expression = ptr->expression;
-        return validateExpression(expression);
-    }
-    if(auto* ptr = dynamic_cast<AST::CodeBlock*>(statement.get())) {
-        enterScope();
-        for(auto& innerStatement : ptr->block)
-        {
-            if(!validateStatement(innerStatement)) return false;
-        }
-        leaveScope();
-        return true;
+void SymbolTable::validateExpression(const AST::Ptr<AST::Expression> &expression)
+{
+    pendingExpressions.clear();
+    pendingExpressions.push_back(expression.get());
+    while(!pendingExpressions.empty())
+    {
+        auto* next = pendingExpressions.back();
+        pendingExpressions.pop_back();
+        AST::visit([this](auto& node) { validate(node); }, *next);
     }
+}
 
-    throw std::invalid_argument("Unrecognized statement");
+void SymbolTable::validate(AST::VariableDeclaration &declaration)
+{
+    validateExpression(declaration.value);
+    declare(declaration);
 }
 
-bool SymbolTable::validateExpression(const std::unique_ptr<AST::Expression> &expression)
+void SymbolTable::validate(AST::VariableAssignment &assignment)
 {
-    if(dynamic_cast<AST::LiteralValue*>(expression.get()))
-        return true;
-    if(auto* ptr = dynamic_cast<AST::VariableValue*>(expression.get())) {
-        auto& variableData = *dynamic_cast<AST::VariableData*>(ptr);
-        resolve(variableData);
-        return true;
-    }
-    if(auto* ptr = dynamic_cast<AST::BinaryOperation*>(expression.get()))
-        return validateExpression(ptr->leftOperand) && validateExpression(ptr->rightOperand);
-    if(auto* ptr = dynamic_cast<AST::UnaryOperation*>(expression.get()))
-        return validateExpression(ptr->operand);
-    
-    throw std::invalid_argument("Unrecognized expression");
+    resolve(assignment);
+    validateExpression(assignment.value);
 }
 
-const SymbolTable::Scope::DeclarationInfo &SymbolTable::getDeclarationInfo(const AST::VariableData &variable)
+void SymbolTable::validate(AST::IfStatement &ifStatement)
 {
-    auto name = variable.getName();
-    for(auto it = scopes.rbegin(); it != scopes.rend(); ++it)
-    {
-        auto& symbols = it->symbols;
-        if(symbols.find(name) == symbols.end()) continue;
+    validateExpression(ifStatement.condition);
+    pendingStatements.push_back(ifStatement.body.get());
+}
 
-        auto& declarationInfo = symbols.at(name);
-        return declarationInfo;
-    }
+void SymbolTable::validate(AST::WhileStatement &whileStatement)
+{
+    validateExpression(whileStatement.condition);
+    pendingStatements.push_back(whileStatement.body.get());
+}
 
-    std::ostringstream oss;
-    oss << "Use of undeclared variable\n" << variable.token;
-    throw std::runtime_error(oss.str());
+void SymbolTable::validate(AST::DisplayStatement &displayStatement)
+{
+    validateExpression(displayStatement.expression);
 }
 
-SymbolTable::Scope::DeclarationInfo::DeclarationInfo(unsigned offset, const Tokenization::Token &declarationToken)
-    : offset(offset), declarationToken(declarationToken) {}
+void SymbolTable::validate(AST::CodeBlock &codeBlock)
+{
+    enterScope();
+    pendingStatements.push_back(nullptr);
+    // pushed last to first, so they are visited in order
+    for(auto it = codeBlock.block.rbegin(); it != codeBlock.block.rend(); ++it)
+        pendingStatements.push_back(it->get());
+}
+
+void SymbolTable::validate(AST::LiteralValue &)
+{
+}
+
+void SymbolTable::validate(AST::VariableValue &variable)
+{
+    resolve(variable);
+}
+
+void SymbolTable::validate(AST::BinaryOperation &operation)
+{
+    pendingExpressions.push_back(operation.rightOperand.get());
+    pendingExpressions.push_back(operation.leftOperand.get());
+}
+
+void SymbolTable::validate(AST::UnaryOperation &operation)
+{
+    pendingExpressions.push_back(operation.operand.get());
+}
+
+const SymbolTable::Declaration &SymbolTable::getDeclaration(const AST::VariableData &variable)
+{
+    auto* slot = findSlot(variable.getSymbol());
+    if(!slot || slot->declaration == none)
+    {
+        std::ostringstream oss;
+        oss << "Use of undeclared variable\n" << variable.token;
+        throw std::runtime_error(oss.str());
+    }
+    return declarations[slot->declaration];
+}
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <unordered_set>
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -9,37 +9,90 @@
 
 class SymbolTable {
 public:
-    SymbolTable(const std::vector<std::unique_ptr<AST::Statement>>& statements);
+    SymbolTable(const std::vector<AST::Ptr<AST::Statement>>& statements);
+    SymbolTable() = default;
     ~SymbolTable() = default;
 
     unsigned getOffset() const;
 
-private:
-    struct Scope {
-        struct DeclarationInfo {
-            DeclarationInfo(unsigned offset, const Tokenization::Token& declarationToken);
+    // Resolves the next top-level statement of the program, returns the deepest offset it reaches
+    unsigned validateTopLevel(const AST::Ptr<AST::Statement>& statement);
+
+    /**
+     *  Re-declares the top-level variables of a statement that was already resolved at the same
+     *  fingerprint, without walking the rest of it. statementMaxOffset is what validateTopLevel
+     *  returned for it back then.
+     */
+    void replayTopLevel(const AST::Ptr<AST::Statement>& statement, unsigned statementMaxOffset);
 
-            const Tokenization::Token& declarationToken;
-            unsigned offset;
-        };
+    // Identifies the top-level variables declared so far together with their offsets
+    uint64_t getFingerprint() const;
 
-        std::unordered_map<std::string, DeclarationInfo> symbols;
-        unsigned savedOffset = 0;
+private:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    /**
+     *  Declarations form a stack in the order they were made, and each one remembers the declaration
+     *  of the same name it shadows: leaving a scope pops its declarations and restores only the names
+     *  it changed. visible maps an interned symbol to its innermost declaration by open addressing.
+     */
+    struct Declaration {
+        uint32_t symbol;
+        unsigned offset;
+        uint32_t shadowed;
+        // a copy, the fused front end drops a statement's tokens once it is lowered
+        Tokenization::Token token;
+    };
+    // symbol 0 is the empty spelling, which never names a variable, so it marks free slots
+    struct Slot {
+        uint32_t symbol = 0;
+        uint32_t declaration = none;
+    };
+    struct Scope {
+        uint32_t firstDeclaration;
+        unsigned savedOffset;
     };
 
+    std::vector<Declaration> declarations;
+    std::vector<Slot> visible = std::vector<Slot>(64);
+    std::size_t usedSlots = 0;
     std::vector<Scope> scopes;
 
+    Slot* findSlot(uint32_t symbol);
+    Slot& claimSlot(uint32_t symbol);
+
     void enterScope();
     void leaveScope();
 
     void declare(AST::VariableData& variable);
     void resolve(AST::VariableData& variable);
 
-    bool validateStatement(const std::unique_ptr<AST::Statement>& statement);
-    bool validateExpression(const std::unique_ptr<AST::Expression>& expression);
+    /**
+     *  The walks keep the nodes still to visit on these stacks instead of recursing, so nesting is only
+     *  bounded by memory. A null statement stands for leaving the scope of a code block.
+     */
+    std::vector<AST::Statement*> pendingStatements;
+    std::vector<AST::Expression*> pendingExpressions;
+
+    void validateStatement(const AST::Ptr<AST::Statement>& statement);
+    void validateExpression(const AST::Ptr<AST::Expression>& expression);
+
+    // One overload per node type, dispatched by AST::visit; nested nodes are pushed to be visited next
+    void validate(AST::VariableDeclaration& declaration);
+    void validate(AST::VariableAssignment& assignment);
+    void validate(AST::IfStatement& ifStatement);
+    void validate(AST::WhileStatement& whileStatement);
+    void validate(AST::DisplayStatement& displayStatement);
+    void validate(AST::CodeBlock& codeBlock);
+    void validate(AST::LiteralValue& literal);
+    void validate(AST::VariableValue& variable);
+    void validate(AST::BinaryOperation& operation);
+    void validate(AST::UnaryOperation& operation);
 
-    const Scope::DeclarationInfo& getDeclarationInfo(const AST::VariableData& variable);
+    // Throws if the variable is not declared in any enclosing scope
+    const Declaration& getDeclaration(const AST::VariableData& variable);
     
     unsigned currentOffset = 0;
     unsigned maxOffset = 0;
+    uint64_t fingerprint = 0xcbf29ce484222325ull;
 };
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include "Toolchain.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+Toolchain::TemporaryDirectory::TemporaryDirectory()
+{
+    auto pattern = (std::filesystem::temp_directory_path() / "ling-XXXXXX").string();
+    if(!mkdtemp(pattern.data()))
+        throw std::system_error(errno, std::generic_category(), "Cannot create temporary directory");
+
+    directory = pattern;
+}
+
+Toolchain::TemporaryDirectory::~TemporaryDirectory()
+{
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+}
+
+const std::filesystem::path &Toolchain::TemporaryDirectory::path() const
+{
+    return directory;
+}
+
+std::filesystem::path Toolchain::getCacheDirectory()
+{
+    std::filesystem::path base;
+    if(auto* cacheHome = std::getenv("XDG_CACHE_HOME"); cacheHome && *cacheHome)
+        base = cacheHome;
+    else if(auto* home = std::getenv("HOME"); home && *home)
+        base = std::filesystem::path(home) / ".cache";
+    else
+        base = std::filesystem::temp_directory_path();
+
+    auto directory = base / "ling";
+    std::filesystem::create_directories(directory);
+    return directory;
+}
+
+uint64_t Toolchain::hash(std::string_view data, uint64_t seed)
+{
+    uint64_t result = seed;
+    for(unsigned char c : data)
+    {
+        result ^= c;
+        result *= 0x100000001b3ull;
+    }
+    return result;
+}
+
+namespace {
+    constexpr uint32_t sha256RoundConstants[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    constexpr uint32_t rotateRight(uint32_t value, int bits)
+    {
+        return value >> bits | value << (32 - bits);
+    }
+}
+
+Toolchain::Sha256::Sha256()
+    : state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19} {}
+
+void Toolchain::Sha256::update(std::string_view data)
+{
+    length += data.size();
+    auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    auto remaining = data.size();
+
+    // whole blocks are compressed in place, only the ragged ends go through the buffer
+    while(remaining > 0)
+    {
+        if(buffered == 0 && remaining >= sizeof(buffer))
+        {
+            compress(bytes);
+            bytes += sizeof(buffer);
+            remaining -= sizeof(buffer);
+            continue;
+        }
+
+        auto count = std::min(remaining, sizeof(buffer) - buffered);
+        std::memcpy(buffer + buffered, bytes, count);
+        buffered += count;
+        bytes += count;
+        remaining -= count;
+
+        if(buffered == sizeof(buffer))
+        {
+            compress(buffer);
+            buffered = 0;
+        }
+    }
+}
+
+std::string Toolchain::Sha256::finish()
+{
+    uint64_t bits = length * 8;
+
+    // a single 1 bit, zeros up to 8 bytes short of a block boundary, then the length in bits
+    update(std::string_view("\x80", 1));
+    while(buffered != 56) update(std::string_view("\0", 1));
+
+    char lengthBytes[8];
+    for(int i = 0; i < 8; ++i) lengthBytes[i] = static_cast<char>(bits >> (56 - 8 * i));
+    update(std::string_view(lengthBytes, sizeof(lengthBytes)));
+
+    std::ostringstream digest;
+    digest << std::hex << std::setfill('0');
+    for(auto word : state) digest << std::setw(8) << word;
+    return digest.str();
+}
+
+void Toolchain::Sha256::compress(const unsigned char* block)
+{
+    uint32_t schedule[64];
+    for(int i = 0; i < 16; ++i)
+        schedule[i] = uint32_t(block[4 * i]) << 24 | uint32_t(block[4 * i + 1]) << 16 | uint32_t(block[4 * i + 2]) << 8 | block[4 * i + 3];
+    for(int i = 16; i < 64; ++i)
+    {
+        auto s0 = rotateRight(schedule[i - 15], 7) ^ rotateRight(schedule[i - 15], 18) ^ schedule[i - 15] >> 3;
+        auto s1 = rotateRight(schedule[i - 2], 17) ^ rotateRight(schedule[i - 2], 19) ^ schedule[i - 2] >> 10;
+        schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+    for(int i = 0; i < 64; ++i)
+    {
+        auto t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) + sha256RoundConstants[i] + schedule[i];
+        auto t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+std::string Toolchain::run(const std::vector<std::string> &arguments, const std::vector<std::pair<int, int>> &inheritedDescriptors)
+{
+    std::vector<char*> argv;
+    for(auto& argument : arguments) argv.push_back(const_cast<char*>(argument.c_str()));
+    argv.push_back(nullptr);
+
+    int errorPipe[2];
+    if(pipe2(errorPipe, O_CLOEXEC) != 0)
+        throw std::system_error(errno, std::generic_category(), "Cannot create pipe for " + arguments.front());
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, errorPipe[1], STDERR_FILENO);
+    for(auto [descriptor, childDescriptor] : inheritedDescriptors)
+        posix_spawn_file_actions_adddup2(&actions, descriptor, childDescriptor);
+
+    pid_t pid;
+    int spawnError = posix_spawnp(&pid, argv.front(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(errorPipe[1]);
+
+    if(spawnError != 0)
+    {
+        close(errorPipe[0]);
+        throw std::system_error(spawnError, std::generic_category(), "Cannot run " + arguments.front());
+    }
+
+    std::string diagnostics;
+    char buffer[4096];
+    for(;;)
+    {
+        auto count = read(errorPipe[0], buffer, sizeof(buffer));
+        if(count > 0) diagnostics.append(buffer, count);
+        else if(count == 0 || errno != EINTR) break;
+    }
+    close(errorPipe[0]);
+
+    int status;
+    while(waitpid(pid, &status, 0) < 0)
+    {
+        if(errno != EINTR)
+            throw std::system_error(errno, std::generic_category(), "Cannot wait for " + arguments.front());
+    }
+
+    if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        return diagnostics;
+
+    std::ostringstream oss;
+    oss << arguments.front();
+    if(WIFEXITED(status)) oss << " exited with code " << WEXITSTATUS(status);
+    else if(WIFSIGNALED(status)) oss << " was killed by signal " << WTERMSIG(status);
+    oss << ":\n" << diagnostics;
+    throw std::runtime_error(oss.str());
+}
+
+// Retries short and interrupted writes until all of data is written; returns 0 or the errno
+static int writeAll(int descriptor, std::string_view data)
+{
+    for(std::size_t written = 0; written < data.size();)
+    {
+        auto count = write(descriptor, data.data() + written, data.size() - written);
+        if(count < 0 && errno == EINTR) continue;
+        if(count < 0) return errno;
+        written += count;
+    }
+    return 0;
+}
+
+Toolchain::OutputFile::OutputFile(const std::filesystem::path &path) : path(path)
+{
+    descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if(descriptor < 0) throw std::runtime_error("Cannot write " + path.string());
+}
+
+Toolchain::OutputFile::~OutputFile()
+{
+    if(descriptor >= 0) ::close(descriptor);
+}
+
+void Toolchain::OutputFile::write(std::string_view data)
+{
+    if(writeAll(descriptor, data)) throw std::runtime_error("Cannot write " + path.string());
+}
+
+void Toolchain::OutputFile::close()
+{
+    int result = ::close(descriptor);
+    descriptor = -1;
+    if(result < 0) throw std::runtime_error("Cannot write " + path.string());
+}
+
+void Toolchain::writeFile(const std::filesystem::path &path, std::string_view data)
+{
+    OutputFile file(path);
+    file.write(data);
+    file.close();
+}
+
+std::string Toolchain::assemble(std::string_view assembly, const std::filesystem::path &object)
+{
+    int descriptor = memfd_create("ling-assembly", MFD_CLOEXEC);
+    if(descriptor < 0)
+    {
+        // no in-memory files on this kernel, fall back to a private temporary file
+        TemporaryDirectory temporary;
+        auto source = temporary.path() / "source.asm";
+        writeFile(source, assembly);
+        return run({"nasm", "-f", "elf64", source.string(), "-o", object.string()});
+    }
+
+    if(int error = writeAll(descriptor, assembly))
+    {
+        close(descriptor);
+        throw std::system_error(error, std::generic_category(), "Cannot write assembly");
+    }
+
+    int childDescriptor = descriptor == 3 ? 4 : 3;
+    std::string diagnostics;
+    try
+    {
+        diagnostics = run({"nasm", "-f", "elf64", "/dev/fd/" + std::to_string(childDescriptor), "-o", object.string()}, {{descriptor, childDescriptor}});
+    }
+    catch(...)
+    {
+        close(descriptor);
+        throw;
+    }
+    close(descriptor);
+    return diagnostics;
+}
+
+std::string Toolchain::link(const std::vector<std::filesystem::path> &objects, const std::filesystem::path &executable)
+{
+    std::vector<std::string> arguments = {"ld"};
+    for(auto& object : objects) arguments.push_back(object.string());
+    arguments.push_back("-o");
+    arguments.push_back(executable.string());
+    return run(arguments);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Helpers for driving the external assembler and linker
+namespace Toolchain {
+    // Uniquely named directory for intermediate files, removed together with its contents on destruction
+    class TemporaryDirectory {
+    public:
+        TemporaryDirectory();
+        ~TemporaryDirectory();
+
+        TemporaryDirectory(const TemporaryDirectory&) = delete;
+        TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+
+        const std::filesystem::path& path() const;
+
+    private:
+        std::filesystem::path directory;
+    };
+
+    // Per-user directory for build artifacts shared between compiler runs
+    std::filesystem::path getCacheDirectory();
+
+    // 64-bit FNV-1a, stable across runs and platforms
+    uint64_t hash(std::string_view data, uint64_t seed = 0xcbf29ce484222325ull);
+
+    // SHA-256, for content addresses where a collision must not be constructible
+    class Sha256 {
+    public:
+        Sha256();
+
+        void update(std::string_view data);
+        // Lowercase hex of the digest; the hasher can not be updated afterwards
+        std::string finish();
+
+    private:
+        void compress(const unsigned char* block);
+
+        uint32_t state[8];
+        unsigned char buffer[64];
+        std::size_t buffered = 0;
+        uint64_t length = 0;
+    };
+
+    /**
+     *  Runs a program found in PATH without going through the shell. Descriptors listed in
+     *  inheritedDescriptors are made available to the child under the paired number. Returns
+     *  whatever the program wrote to stderr (warnings) so callers decide when to print it. Throws
+     *  with the program's diagnostics if it cannot be started or does not exit successfully.
+     */
+    std::string run(const std::vector<std::string>& arguments, const std::vector<std::pair<int, int>>& inheritedDescriptors = {});
+
+    // A file replaced on construction and filled with plain write calls; throws "Cannot write <path>" on any failure
+    class OutputFile {
+    public:
+        explicit OutputFile(const std::filesystem::path& path);
+        ~OutputFile();
+
+        OutputFile(const OutputFile&) = delete;
+        OutputFile& operator=(const OutputFile&) = delete;
+
+        void write(std::string_view data);
+        void close();
+
+    private:
+        std::filesystem::path path;
+        int descriptor;
+    };
+
+    // Replaces the file at path with data
+    void writeFile(const std::filesystem::path& path, std::string_view data);
+
+    // Streams the assembly to nasm through an in-memory file, nothing is written to disk but the object
+    std::string assemble(std::string_view assembly, const std::filesystem::path& object);
+    std::string link(const std::vector<std::filesystem::path>& objects, const std::filesystem::path& executable);
+};
@@ -0,0 +1,101 @@
+#include "BuildCache.hpp"
+#include "../backend/Toolchain.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // Any rebuild of the compiler changes the size or the modification time of its binary
+    uint64_t getCompilerIdentity()
+    {
+        struct stat info;
+        if(stat("/proc/self/exe", &info) != 0) return 0;
+
+        uint64_t identity = Toolchain::hash(std::string_view(reinterpret_cast<const char*>(&info.st_size), sizeof(info.st_size)));
+        identity = Toolchain::hash(std::string_view(reinterpret_cast<const char*>(&info.st_mtim), sizeof(info.st_mtim)), identity);
+        return identity;
+    }
+
+    // Copies next to destination first, so a running executable of the same name is replaced rather than overwritten
+    void copyAtomically(const std::filesystem::path& from, const std::filesystem::path& to)
+    {
+        auto staging = to;
+        staging += "." + std::to_string(getpid()) + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+        std::filesystem::copy_file(from, staging, std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::rename(staging, to);
+    }
+}
+
+BuildCache::BuildCache() : directory(Toolchain::getCacheDirectory() / "builds"), maxSize(256ull << 20), compilerIdentity(getCompilerIdentity())
+{
+    std::filesystem::create_directories(directory);
+
+    if(auto* size = std::getenv("LING_CACHE_SIZE"); size && *size)
+        maxSize = std::strtoull(size, nullptr, 10) << 20;
+}
+
+std::string BuildCache::makeKey(std::string_view source, std::string_view flags) const
+{
+    // flags never contain a NUL, so the terminator keeps them apart from the source
+    Toolchain::Sha256 key;
+    key.update(std::string_view(reinterpret_cast<const char*>(&compilerIdentity), sizeof(compilerIdentity)));
+    key.update(flags);
+    key.update(std::string_view("\0", 1));
+    key.update(source);
+    return key.finish();
+}
+
+bool BuildCache::fetch(const std::string &key, const std::filesystem::path &destination)
+{
+    auto entry = directory / key;
+
+    std::error_code error;
+    std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), error);
+    if(error) return false;
+
+    copyAtomically(entry, destination);
+    return true;
+}
+
+void BuildCache::store(const std::string &key, const std::filesystem::path &artifact)
+{
+    std::lock_guard lock(mutex);
+    copyAtomically(artifact, directory / key);
+}
+
+void BuildCache::evict()
+{
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type lastUse;
+        uintmax_t size;
+    };
+
+    std::lock_guard lock(mutex);
+    std::vector<Entry> entries;
+    uintmax_t totalSize = 0;
+
+    std::error_code error;
+    for(auto& file : std::filesystem::directory_iterator(directory, error))
+    {
+        if(!file.is_regular_file(error)) continue;
+
+        Entry entry{file.path(), file.last_write_time(error), file.file_size(error)};
+        if(error) continue;
+
+        totalSize += entry.size;
+        entries.push_back(std::move(entry));
+    }
+
+    if(totalSize <= maxSize) return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+    for(auto& entry : entries)
+    {
+        if(totalSize <= maxSize) break;
+        if(std::filesystem::remove(entry.path, error)) totalSize -= entry.size;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+/**
+ *  Content-addressed store of build outputs, kept in the "builds" subdirectory of the cache directory.
+ *
+ *  Entries are keyed by a SHA-256 of the source bytes, the identity of the compiler binary and the
+ *  flags that affect the output, so a hit can be copied out without running the front end at all. Fetching
+ *  an entry refreshes its modification time, which serves as the LRU order when the cache grows
+ *  beyond its size limit ($LING_CACHE_SIZE megabytes, 256 by default).
+ */
+class BuildCache {
+public:
+    BuildCache();
+
+    std::string makeKey(std::string_view source, std::string_view flags) const;
+
+    // Copies the entry to destination; returns false on a miss
+    bool fetch(const std::string& key, const std::filesystem::path& destination);
+    void store(const std::string& key, const std::filesystem::path& artifact);
+
+    // Removes the least recently used entries until the cache fits its size limit
+    void evict();
+
+private:
+    std::filesystem::path directory;
+    uintmax_t maxSize;
+    uint64_t compilerIdentity;
+    std::mutex mutex;
+};
@@ -0,0 +1,262 @@
+#include "Document.hpp"
+#include "../frontend/Parser.hpp"
+#include "../backend/CodeGen.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <sstream>
+
+Document::Document(std::string text, bool lineBufferedOutput, std::size_t nestingLimit)
+    : text(std::move(text)), source(this->text), lineBufferedOutput(lineBufferedOutput), nestingLimit(nestingLimit)
+{
+    // every line ends with a newline, so that edits always replace whole lines
+    if(!this->text.empty() && this->text.back() != '\n') this->text += '\n';
+    source.update(this->text);
+
+    for(std::size_t i = 0; i < this->text.size(); i = this->text.find('\n', i) + 1)
+        lineStarts.push_back(i);
+}
+
+bool Document::compile(std::ostream &diagnostics)
+{
+    auto start = std::chrono::steady_clock::now();
+    statistics = {};
+
+    bool success = reparseAll(diagnostics) && generate(diagnostics);
+
+    statistics.statements = units.size();
+    statistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return success;
+}
+
+bool Document::edit(unsigned firstLine, unsigned lineCount, std::string_view replacement, std::ostream &diagnostics)
+{
+    auto start = std::chrono::steady_clock::now();
+    statistics = {};
+
+    if(firstLine == 0 || firstLine > lineStarts.size() + 1 || lineCount > lineStarts.size() + 1 - firstLine)
+    {
+        diagnostics << "Edit of lines " << firstLine << "-" << firstLine + lineCount << " outside of the " << lineStarts.size() << " lines of the document\n";
+        return false;
+    }
+
+    std::string replacementText(replacement);
+    if(!replacementText.empty() && replacementText.back() != '\n') replacementText += '\n';
+
+    auto byteBegin = getLineStart(firstLine);
+    auto byteEnd = getLineStart(firstLine + lineCount);
+
+    text.replace(byteBegin, byteEnd - byteBegin, replacementText);
+    source.update(text);
+
+    std::vector<std::size_t> insertedStarts;
+    for(std::size_t i = 0; i < replacementText.size(); i = replacementText.find('\n', i) + 1)
+        insertedStarts.push_back(byteBegin + i);
+
+    auto byteDelta = static_cast<std::ptrdiff_t>(replacementText.size()) - static_cast<std::ptrdiff_t>(byteEnd - byteBegin);
+    auto lineDelta = static_cast<int>(insertedStarts.size()) - static_cast<int>(lineCount);
+
+    auto replacedBegin = lineStarts.begin() + (firstLine - 1);
+    for(auto it = replacedBegin + lineCount; it != lineStarts.end(); ++it) *it += byteDelta;
+    replacedBegin = lineStarts.erase(replacedBegin, replacedBegin + lineCount);
+    lineStarts.insert(replacedBegin, insertedStarts.begin(), insertedStarts.end());
+
+    bool success;
+    if(fullReparse) success = reparseAll(diagnostics);
+    else
+    {
+        // the statements on the replaced lines, widened by the statements sharing lines with them
+        unsigned regionBegin = firstLine, regionEnd = firstLine + lineCount;
+        auto first = std::partition_point(units.begin(), units.end(), [&](const Unit& unit) { return unit.lastLine < regionBegin; });
+        auto last = std::partition_point(first, units.end(), [&](const Unit& unit) { return unit.firstLine < regionEnd; });
+
+        if(first != last)
+        {
+            regionBegin = std::min(regionBegin, first->firstLine);
+            regionEnd = std::max(regionEnd, std::prev(last)->lastLine + 1);
+        }
+        while(first != units.begin() && std::prev(first)->lastLine >= regionBegin)
+        {
+            --first;
+            regionBegin = std::min(regionBegin, first->firstLine);
+        }
+        while(last != units.end() && last->firstLine < regionEnd)
+        {
+            regionEnd = std::max(regionEnd, last->lastLine + 1);
+            ++last;
+        }
+
+        std::vector<Unit> parsed;
+        std::ostringstream ignored;
+        if(parseLines(regionBegin, regionEnd + lineDelta, parsed, false, ignored))
+        {
+            for(auto it = last; it != units.end(); ++it)
+            {
+                it->firstLine += lineDelta;
+                it->lastLine += lineDelta;
+                for(auto i = it->tokensBegin; i < it->tokensEnd; ++i)
+                {
+                    auto& token = (*it->tokens)[i];
+                    token.offset = static_cast<uint32_t>(token.offset + byteDelta);
+                }
+            }
+
+            statistics.reparsed = parsed.size();
+            auto position = units.erase(first, last);
+            units.insert(position, std::make_move_iterator(parsed.begin()), std::make_move_iterator(parsed.end()));
+            success = true;
+        }
+        // the region parses differently in the context of the whole text, let the full parse report it
+        else success = reparseAll(diagnostics);
+    }
+
+    if(success) success = generate(diagnostics);
+
+    statistics.statements = units.size();
+    statistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return success;
+}
+
+const std::string &Document::getAssembly() const
+{
+    return assembly;
+}
+
+const Document::Statistics &Document::getStatistics() const
+{
+    return statistics;
+}
+
+std::size_t Document::getLineStart(unsigned line) const
+{
+    return line <= lineStarts.size() ? lineStarts[line - 1] : text.size();
+}
+
+unsigned Document::getLine(std::size_t offset) const
+{
+    return std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) - lineStarts.begin();
+}
+
+bool Document::parseLines(unsigned firstLine, unsigned endLine, std::vector<Unit> &parsed, bool wholeText, std::ostream &diagnostics)
+{
+    auto tokens = std::make_shared<std::vector<Tokenization::Token>>();
+    auto arena = std::make_shared<AST::Arena>();
+    try
+    {
+        *tokens = Tokenization::tokenize(source, getLineStart(firstLine), getLineStart(endLine));
+    }
+    catch(std::exception& e)
+    {
+        diagnostics << "\n\tCompilation error during tokenization:\n" << e.what() << "\n";
+        return false;
+    }
+
+    Parser::VectorCursor cursor(*tokens);
+    if(nestingLimit) cursor.setNestingLimit(nestingLimit);
+    for(; !cursor.atEnd(); cursor.advance())
+    {
+        if(cursor.get().type == Tokenization::Token::Type::BraceRight)
+        {
+            // like Parser::parseTokens, a stray '}' ends the program; a region can not tell what it closes
+            if(!wholeText) return false;
+            fullReparse = true;
+            break;
+        }
+
+        auto statementBegin = cursor.getPosition();
+        AST::Ptr<AST::Statement> statement;
+        try
+        {
+            statement = Parser::parseStatement(cursor, *arena);
+            if(cursor.atEnd())
+                throw std::runtime_error("Structure not met (end of tokens where token was expected)\n" + cursor.getPrevious().getErrorLine());
+        }
+        catch(std::exception& e)
+        {
+            diagnostics << "\n\tCompilation error during parsing:\n" << e.what() << "\n";
+            return false;
+        }
+
+        Unit unit;
+        unit.tokens = tokens;
+        unit.arena = arena;
+        unit.tokensBegin = statementBegin;
+        unit.tokensEnd = cursor.getPosition() + 1;
+        unit.firstLine = getLine((*tokens)[statementBegin].offset);
+        unit.lastLine = getLine(cursor.get().offset);
+        unit.statement = std::move(statement);
+        parsed.push_back(std::move(unit));
+    }
+
+    return true;
+}
+
+bool Document::reparseAll(std::ostream &diagnostics)
+{
+    units.clear();
+    fullReparse = false;
+
+    if(!parseLines(1, lineStarts.size() + 1, units, true, diagnostics))
+    {
+        units.clear();
+        fullReparse = true;
+        return false;
+    }
+
+    statistics.reparsed = units.size();
+    return true;
+}
+
+bool Document::generate(std::ostream &diagnostics)
+{
+    table.emplace();
+    for(auto& unit : units)
+    {
+        auto fingerprint = table->getFingerprint();
+        if(unit.resolved && unit.fingerprint == fingerprint)
+        {
+            table->replayTopLevel(unit.statement, unit.maxOffset);
+            continue;
+        }
+
+        unit.resolved = false;
+        unit.ir.reset();
+        try
+        {
+            unit.maxOffset = table->validateTopLevel(unit.statement);
+        }
+        catch(std::exception& e)
+        {
+            diagnostics << "\n\tCompilation error during variable resolution:\n" << e.what() << "\n";
+            return false;
+        }
+        unit.resolved = true;
+        unit.fingerprint = fingerprint;
+        ++statistics.resolved;
+    }
+
+    std::vector<const BuilderIR*> fragments;
+    fragments.reserve(units.size());
+    for(auto& unit : units)
+    {
+        if(!unit.ir)
+        {
+            unit.ir.emplace(unit.statement);
+            ++statistics.lowered;
+        }
+        fragments.push_back(&*unit.ir);
+    }
+    BuilderIR program(fragments);
+
+    try
+    {
+        CodeGen gen(program, *table, lineBufferedOutput);
+        assembly = gen.getAssembly();
+    }
+    catch(std::exception& e)
+    {
+        diagnostics << "\n\tCompilation error during code generation:\n" << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../frontend/Tokens.hpp"
+#include "../frontend/AST.hpp"
+#include "../backend/SymbolTable.hpp"
+#include "../backend/IR.hpp"
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ *  A source file kept open by the compile server.
+ *
+ *  The program is held as one unit per top-level statement, each with its own tokens, AST, the
+ *  symbol table fingerprint it was resolved at and its lowered IR. An edit re-tokenizes and
+ *  re-parses only the lines of the statements it touches; the other statements keep their AST.
+ *  Resolution replays statements whose preceding top-level declarations did not change, and only
+ *  re-resolved statements are lowered again before the fragments are glued and code is generated.
+ */
+class Document {
+public:
+    struct Statistics {
+        std::size_t statements = 0;
+        std::size_t reparsed = 0;
+        std::size_t resolved = 0;
+        std::size_t lowered = 0;
+        double milliseconds = 0;
+    };
+
+    // A nestingLimit of 0 keeps the parser's default
+    Document(std::string text, bool lineBufferedOutput, std::size_t nestingLimit = 0);
+
+    // Compiles the whole text; returns false and writes the diagnostics on errors
+    bool compile(std::ostream& diagnostics);
+
+    // Replaces lineCount lines starting at firstLine (counted from 1) with text and recompiles
+    bool edit(unsigned firstLine, unsigned lineCount, std::string_view replacement, std::ostream& diagnostics);
+
+    const std::string& getAssembly() const;
+    const Statistics& getStatistics() const;
+
+private:
+    struct Unit {
+        // shared by the statements parsed together, the AST refers to the tokens and lives in the arena
+        std::shared_ptr<std::vector<Tokenization::Token>> tokens;
+        std::shared_ptr<AST::Arena> arena;
+        std::size_t tokensBegin, tokensEnd;
+        unsigned firstLine, lastLine;
+
+        AST::Ptr<AST::Statement> statement;
+
+        bool resolved = false;
+        uint64_t fingerprint = 0;
+        unsigned maxOffset = 0;
+
+        std::optional<BuilderIR> ir;
+    };
+
+    std::string text;
+    // tokens refer to the text through its registration, which follows the text across edits
+    Tokenization::Source source;
+    std::vector<std::size_t> lineStarts;
+    const bool lineBufferedOutput;
+    const std::size_t nestingLimit;
+
+    std::vector<Unit> units;
+    // after a parse error, or when a stray '}' ends the program early, statements are no longer independent
+    bool fullReparse = true;
+
+    std::optional<SymbolTable> table;
+    std::string assembly;
+    Statistics statistics;
+
+    std::size_t getLineStart(unsigned line) const;
+    unsigned getLine(std::size_t offset) const;
+
+    bool parseLines(unsigned firstLine, unsigned endLine, std::vector<Unit>& parsed, bool wholeText, std::ostream& diagnostics);
+    bool reparseAll(std::ostream& diagnostics);
+    bool generate(std::ostream& diagnostics);
+};
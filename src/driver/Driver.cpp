@@ -0,0 +1,529 @@
+#include "Driver.hpp"
+#include "ThreadPool.hpp"
+#include "BuildCache.hpp"
+#include "Server.hpp"
+#include "SourceFile.hpp"
+#include "../frontend/Tokens.hpp"
+#include "../frontend/Parser.hpp"
+#include "../backend/SymbolTable.hpp"
+#include "../backend/IR.hpp"
+#include "../backend/CodeGen.hpp"
+#include "../backend/Interpreter.hpp"
+#include "../backend/JIT.hpp"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // The source "-" is read from stdin and its outputs are named "stdin"
+    std::string getSourcePath(const std::string& name)
+    {
+        return name == "-" ? name : name + ".ling";
+    }
+
+    std::string getDisplayName(const std::string& name)
+    {
+        return name == "-" ? "<stdin>" : name + ".ling";
+    }
+
+    std::string getOutputBase(const std::string& name)
+    {
+        return name == "-" ? "stdin" : name;
+    }
+
+    // Everything produced by the front end, in dependency order: tokens refer to the registered file, the AST to the tokens
+    struct Program {
+        // Throws if the source can not be opened
+        explicit Program(const std::string& name) : file(getSourcePath(name)), source(file.getText()) {}
+
+        SourceFile file;
+        Tokenization::Source source;
+        std::vector<Tokenization::Token> tokens;
+        // the tokens the AST refers to, when the tokens were streamed
+        std::deque<Tokenization::Token> keptTokens;
+        AST::Arena arena;
+        std::vector<AST::Ptr<AST::Statement>> statements;
+        std::optional<SymbolTable> table;
+        std::optional<BuilderIR> ir;
+        // of the fused front end, reported only if parsing succeeds
+        std::exception_ptr resolutionError;
+    };
+
+    struct FileResult {
+        bool success = false;
+        bool cached = false;
+        std::string cacheKey;
+        std::ostringstream diagnostics;
+        std::string assembly;
+
+        double frontEndMilliseconds = 0;
+        double codeGenMilliseconds = 0;
+        double toolchainMilliseconds = 0;
+    };
+
+    // A single source may use all the jobs for tokenizing, several sources already run in parallel
+    unsigned getTokenizerThreads(const Driver::Options& options)
+    {
+        return options.sources.size() == 1 ? options.jobs : 1;
+    }
+
+    // Below this a mapped source is tokenized whole, a producer thread would cost more than the tokens' memory
+    constexpr std::size_t streamingThreshold = 1 << 20;
+
+    bool useTokenStream(const Program& program, unsigned tokenizerThreads)
+    {
+        return tokenizerThreads == 1 && (!program.file.isMapped() || program.file.getText().size() >= streamingThreshold);
+    }
+
+    /**
+     *  The fused front end resolves and lowers every top-level statement as soon as it is parsed, then
+     *  gives its nodes and kept tokens back, so the AST never holds more than one statement. Resolution
+     *  errors wait for the end of the parse, which keeps the diagnostics of the multi-pass front end.
+     */
+    void parseProgram(Program& program, Parser::TokenCursor& cursor, const Driver::Options& options)
+    {
+        if(options.maxNesting) cursor.setNestingLimit(options.maxNesting);
+        if(options.multiPass)
+        {
+            program.statements = Parser::parseTokens(cursor, program.arena);
+            return;
+        }
+
+        program.table.emplace();
+        program.ir.emplace();
+        while(true)
+        {
+            auto mark = program.arena.getMark();
+            auto statement = Parser::parseNextStatement(cursor, program.arena);
+            if(!statement) break;
+
+            if(!program.resolutionError)
+            {
+                try
+                {
+                    program.table->validateTopLevel(statement);
+                    program.ir->lowerStatement(statement);
+                }
+                catch(std::exception&)
+                {
+                    program.resolutionError = std::current_exception();
+                }
+            }
+
+            program.arena.rewind(mark);
+            program.keptTokens.clear();
+        }
+    }
+
+    // Parses while a producer thread tokenizes; a tokenization error anywhere still wins over parse errors
+    bool parseStreamed(Program& program, const Driver::Options& options, std::ostream& diagnostics)
+    {
+        std::exception_ptr parseError;
+        {
+            Tokenization::TokenStream stream(program.file, program.source);
+            Parser::StreamCursor cursor(stream, program.keptTokens);
+            try
+            {
+                parseProgram(program, cursor, options);
+            }
+            catch(std::exception&)
+            {
+                parseError = std::current_exception();
+            }
+
+            try
+            {
+                stream.finish();
+            }
+            catch(std::exception& e)
+            {
+                diagnostics << "\n\tCompilation error during tokenization:\n" << e.what() << "\n";
+                return false;
+            }
+        }
+
+        try
+        {
+            if(parseError) std::rethrow_exception(parseError);
+        }
+        catch(std::exception& e)
+        {
+            diagnostics << "\n\tCompilation error during parsing:\n" << e.what() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool parseWhole(Program& program, const Driver::Options& options, std::ostream& diagnostics)
+    {
+        try
+        {
+            program.tokens = Tokenization::tokenize(program.file, program.source, getTokenizerThreads(options));
+        }
+        catch(std::exception& e)
+        {
+            diagnostics << "\n\tCompilation error during tokenization:\n" << e.what() << "\n";
+            return false;
+        }
+
+        Parser::VectorCursor cursor(program.tokens);
+        try
+        {
+            parseProgram(program, cursor, options);
+        }
+        catch(std::exception& e)
+        {
+            diagnostics << "\n\tCompilation error during parsing:\n" << e.what() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Fused unless options.multiPass, which keeps the AST and walks it once per pass like the compile server does
+    bool runFrontEnd(Program& program, const Driver::Options& options, std::ostream& diagnostics)
+    {
+        bool parsed = useTokenStream(program, getTokenizerThreads(options)) ? parseStreamed(program, options, diagnostics)
+                                                                            : parseWhole(program, options, diagnostics);
+        if(!parsed) return false;
+
+        try
+        {
+            if(program.resolutionError) std::rethrow_exception(program.resolutionError);
+            if(options.multiPass) program.table.emplace(program.statements);
+        }
+        catch(std::exception& e)
+        {
+            diagnostics << "\n\tCompilation error during variable resolution:\n" << e.what() << "\n";
+            return false;
+        }
+
+        if(options.multiPass) program.ir.emplace(program.statements);
+        else program.ir->tryOptimize();
+        return true;
+    }
+
+    int execute(const Driver::Options& options, const std::string& name)
+    {
+        std::optional<Program> program;
+        try
+        {
+            program.emplace(name);
+        }
+        catch(std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return -1;
+        }
+        if(!runFrontEnd(*program, options, std::cerr)) return -1;
+
+        JIT jit;
+        try
+        {
+            Interpreter interpreter(*program->ir, *program->table);
+            interpreter.setLineBuffered(options.lineBuffered);
+            interpreter.run(std::cout, options.tiered ? &jit : nullptr);
+        }
+        catch(std::exception& e)
+        {
+            std::cerr << "\n\tRuntime error:\n" << e.what() << "\n";
+            return -1;
+        }
+        if(options.tiered && options.stats) jit.printStats(std::cerr);
+        return 0;
+    }
+
+    std::string getOutputName(const Driver::Options& options, const std::string& name)
+    {
+        return options.fullCompile ? getOutputBase(name) : getOutputBase(name) + ".asm";
+    }
+
+    void storeInCache(BuildCache* cache, const Driver::Options& options, const std::string& name, const FileResult& result)
+    {
+        if(!cache || result.cacheKey.empty() || !result.success) return;
+
+        // the cache is only an optimization, a full disk or a racing eviction must not fail the build
+        try
+        {
+            cache->store(result.cacheKey, getOutputName(options, name));
+        }
+        catch(std::exception&) {}
+    }
+
+    // Front end and code generation; leaves the assembly in the result for buildExecutable
+    void compile(const Driver::Options& options, BuildCache* cache, const std::string& name, FileResult& result)
+    {
+        auto start = Clock::now();
+        std::optional<Program> program;
+        try
+        {
+            program.emplace(name);
+        }
+        catch(std::exception& e)
+        {
+            result.diagnostics << "\n" << e.what() << "\n";
+            result.frontEndMilliseconds = millisecondsSince(start);
+            return;
+        }
+
+        // the key covers the whole text, which streamed input only has once it is parsed; such
+        // sources are rarely built twice, so they skip the cache rather than lose the streaming
+        if(cache && program->file.isMapped())
+        {
+            // every option that can change the output or whether the build succeeds
+            std::string flags = options.fullCompile ? "executable" : "assembly";
+            if(options.lineBuffered) flags += ",line-buffered";
+            if(options.multiPass) flags += ",multi-pass";
+            if(options.maxNesting) flags += ",max-nesting=" + std::to_string(options.maxNesting);
+            result.cacheKey = cache->makeKey(program->file.getText(), flags);
+
+            try
+            {
+                result.cached = result.success = cache->fetch(result.cacheKey, getOutputName(options, name));
+            }
+            catch(std::exception&) {}
+
+            if(result.cached)
+            {
+                result.frontEndMilliseconds = millisecondsSince(start);
+                return;
+            }
+        }
+
+        bool parsed = runFrontEnd(*program, options, result.diagnostics);
+        result.frontEndMilliseconds = millisecondsSince(start);
+        if(!parsed) return;
+
+        start = Clock::now();
+        try
+        {
+            CodeGen gen(*program->ir, *program->table, options.lineBuffered);
+            if(options.fullCompile) result.assembly = gen.getAssembly();
+            else gen.generateAssembly(getOutputBase(name));
+            result.success = true;
+        }
+        catch(std::exception& e)
+        {
+            result.diagnostics << "\n\tCompilation error during code generation:\n" << e.what() << "\n";
+        }
+        result.codeGenMilliseconds = millisecondsSince(start);
+
+        if(!options.fullCompile) storeInCache(cache, options, name, result);
+    }
+
+    void buildExecutable(const Driver::Options& options, BuildCache* cache, const std::string& name, FileResult& result)
+    {
+        auto start = Clock::now();
+        try
+        {
+            result.diagnostics << CodeGen::buildExecutable(result.assembly, getOutputBase(name));
+        }
+        catch(std::exception& e)
+        {
+            result.success = false;
+            result.diagnostics << "\n\tCompilation error during code generation:\n" << e.what() << "\n";
+        }
+        result.assembly.clear();
+        result.assembly.shrink_to_fit();
+        result.toolchainMilliseconds = millisecondsSince(start);
+
+        storeInCache(cache, options, name, result);
+    }
+
+    void printSummary(const Driver::Options& options, const std::vector<FileResult>& results, double wallMilliseconds)
+    {
+        std::size_t width = 4;
+        for(auto& source : options.sources) width = std::max(width, getDisplayName(source).size() + 1);
+
+        std::cerr << std::fixed << std::setprecision(2)
+                  << std::left << std::setw(width) << "file"
+                  << std::right << std::setw(14) << "front end ms" << std::setw(12) << "codegen ms" << std::setw(16) << "asm + link ms"
+                  << "  status\n";
+
+        for(std::size_t i = 0; i < results.size(); ++i)
+        {
+            auto& result = results[i];
+            std::cerr << std::left << std::setw(width) << getDisplayName(options.sources[i])
+                      << std::right << std::setw(14) << result.frontEndMilliseconds
+                      << std::setw(12) << result.codeGenMilliseconds
+                      << std::setw(16) << result.toolchainMilliseconds
+                      << "  " << (result.cached ? "cached" : result.success ? "ok" : "failed") << "\n";
+        }
+
+        if(options.useCache)
+        {
+            auto hits = std::count_if(results.begin(), results.end(), [](const FileResult& result) { return result.cached; });
+            std::cerr << "cache: " << hits << " hit(s), " << results.size() - hits << " miss(es)\n";
+        }
+
+        std::cerr << results.size() << " file(s) on " << options.jobs << " thread(s) in " << wallMilliseconds << "ms\n";
+    }
+}
+
+std::string Driver::readSource(const std::string &name)
+{
+    SourceFile file(getSourcePath(name));
+    file.readAll();
+    return std::string(file.getText());
+}
+
+bool Driver::parseArguments(int argc, char **argv, Options &options)
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if(argument[0] != '-' || argument == "-")
+        {
+            if(argument == "-" && std::count(options.sources.begin(), options.sources.end(), argument))
+            {
+                std::cerr << "stdin can only be compiled once\n";
+                return false;
+            }
+            options.sources.push_back(argument);
+            continue;
+        }
+
+        if(argument == "-s")
+            options.fullCompile = false;
+        if(argument == "-r")
+            options.interpret = true;
+        if(argument == "-t")
+            options.interpret = options.tiered = true;
+        if(argument == "--stats")
+            options.stats = true;
+        if(argument == "-l")
+            options.lineBuffered = true;
+        if(argument == "--no-cache")
+            options.useCache = false;
+        if(argument == "--multi-pass")
+            options.multiPass = true;
+        if(argument == "--serve")
+        {
+            if(i + 1 == argc)
+            {
+                std::cerr << "Missing socket path after --serve\n";
+                return false;
+            }
+            options.serveSocket = argv[++i];
+        }
+        if(argument == "--max-nesting")
+        {
+            std::string limit = i + 1 < argc ? argv[++i] : "";
+            if(limit.empty() || limit.find_first_not_of("0123456789") != std::string::npos || std::stoull(limit) == 0)
+            {
+                std::cerr << "Invalid nesting limit: '" << limit << "'\n";
+                return false;
+            }
+            options.maxNesting = std::stoull(limit);
+        }
+        if(argument.starts_with("-j"))
+        {
+            std::string count = argument.size() > 2 ? argument.substr(2) : (i + 1 < argc ? argv[++i] : "");
+            if(count.empty() || count.find_first_not_of("0123456789") != std::string::npos || std::stoul(count) == 0)
+            {
+                std::cerr << "Invalid number of jobs: '" << count << "'\n";
+                return false;
+            }
+            options.jobs = std::stoul(count);
+        }
+    }
+
+    if(options.sources.empty() && options.serveSocket.empty())
+    {
+        std::cout << "Usage: " << argv[0] << " [fileToCompile | -]... [-j jobs]\n"
+                  << "       " << argv[0] << " --serve [socket]\n";
+        return false;
+    }
+
+    return true;
+}
+
+int Driver::run(const Options &options)
+{
+    if(!options.serveSocket.empty())
+        return Server::run(options.serveSocket, options);
+
+    if(options.interpret)
+    {
+        int status = 0;
+        for(auto& source : options.sources)
+            if(execute(options, source) != 0) status = -1;
+        return status;
+    }
+
+    auto start = Clock::now();
+    std::vector<FileResult> results(options.sources.size());
+
+    std::optional<BuildCache> buildCache;
+    if(options.useCache)
+    {
+        try
+        {
+            buildCache.emplace();
+        }
+        catch(std::exception& e)
+        {
+            std::cerr << "Build cache disabled: " << e.what() << "\n";
+        }
+    }
+    BuildCache* cache = buildCache ? &*buildCache : nullptr;
+
+    if(options.jobs == 1)
+    {
+        for(std::size_t i = 0; i < options.sources.size(); ++i)
+        {
+            compile(options, cache, options.sources[i], results[i]);
+            if(results[i].success && !results[i].cached && options.fullCompile) buildExecutable(options, cache, options.sources[i], results[i]);
+        }
+    }
+    else
+    {
+        ThreadPool pool(options.jobs);
+        for(std::size_t i = 0; i < options.sources.size(); ++i)
+        {
+            pool.submit([&options, &results, &pool, cache, i]() {
+                compile(options, cache, options.sources[i], results[i]);
+                if(!results[i].success || results[i].cached || !options.fullCompile) return;
+
+                // assembling and linking wait on external processes, let another worker pick up the next file meanwhile
+                pool.submit([&options, &results, cache, i]() { buildExecutable(options, cache, options.sources[i], results[i]); });
+            });
+        }
+        pool.wait();
+    }
+
+    int status = 0;
+    for(std::size_t i = 0; i < results.size(); ++i)
+    {
+        auto diagnostics = results[i].diagnostics.str();
+        if(!diagnostics.empty())
+        {
+            if(results.size() > 1) std::cerr << getDisplayName(options.sources[i]) << ":";
+            std::cerr << diagnostics;
+        }
+        if(!results[i].success) status = -1;
+    }
+
+    if(cache)
+    {
+        try
+        {
+            cache->evict();
+        }
+        catch(std::exception&) {}
+    }
+
+    if(results.size() > 1 || options.stats) printSummary(options, results, millisecondsSince(start));
+
+    return status;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Driver {
+    struct Options {
+        std::vector<std::string> sources;
+
+        bool fullCompile = true;
+        bool interpret = false;
+        bool tiered = false;
+        bool stats = false;
+        bool lineBuffered = false;
+        bool useCache = true;
+        // keep the whole AST and resolve and lower it in separate passes, see runFrontEnd
+        bool multiPass = false;
+        // with --max-nesting, the deepest nesting a program may have; 0 keeps the parser's default
+        std::size_t maxNesting = 0;
+        unsigned jobs = 1;
+
+        // with --serve, the path of the compile server's socket
+        std::string serveSocket;
+    };
+
+    // Reads <name>.ling, or stdin for "-"; throws if it can not be read
+    std::string readSource(const std::string& name);
+
+    // Returns false and prints the usage if the arguments are malformed
+    bool parseArguments(int argc, char** argv, Options& options);
+
+    /**
+     *  Compiles (or runs) every source in options.sources.
+     *
+     *  With more than one source the front end and code generation of each file run as a task
+     *  on a work-stealing pool of options.jobs threads; once a file's assembly is ready a
+     *  follow-up task assembles and links it, overlapping with the front end of later files.
+     *  Diagnostics are printed in the order of the sources regardless of completion order.
+     *  Outputs of sources compiled before with the same flags are taken from the BuildCache;
+     *  piped sources are not cached, so they keep being tokenized as they are read.
+     */
+    int run(const Options& options);
+};
@@ -0,0 +1,256 @@
+#include "Server.hpp"
+#include "Document.hpp"
+#include "../backend/CodeGen.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    class Connection {
+    public:
+        explicit Connection(int descriptor) : descriptor(descriptor) {}
+        ~Connection() { close(descriptor); }
+
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        bool readLine(std::string& line)
+        {
+            for(;;)
+            {
+                auto newLine = buffer.find('\n', position);
+                if(newLine != std::string::npos)
+                {
+                    line.assign(buffer, position, newLine - position);
+                    position = newLine + 1;
+                    return true;
+                }
+                if(!fill()) return false;
+            }
+        }
+
+        bool readBytes(std::size_t count, std::string& bytes)
+        {
+            while(buffer.size() - position < count)
+                if(!fill()) return false;
+
+            bytes.assign(buffer, position, count);
+            position += count;
+            return true;
+        }
+
+        bool reply(bool success, const std::string& payload)
+        {
+            auto message = (success ? "ok " : "error ") + std::to_string(payload.size()) + "\n" + payload;
+            for(std::size_t sent = 0; sent < message.size();)
+            {
+                auto count = send(descriptor, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+                if(count < 0 && errno == EINTR) continue;
+                if(count < 0) return false;
+                sent += count;
+            }
+            return true;
+        }
+
+    private:
+        int descriptor;
+        std::string buffer;
+        std::size_t position = 0;
+
+        bool fill()
+        {
+            buffer.erase(0, position);
+            position = 0;
+
+            char chunk[65536];
+            for(;;)
+            {
+                auto count = read(descriptor, chunk, sizeof(chunk));
+                if(count > 0)
+                {
+                    buffer.append(chunk, count);
+                    return true;
+                }
+                if(count == 0 || errno != EINTR) return false;
+            }
+        }
+    };
+
+    struct OpenFile {
+        std::unique_ptr<Document> document;
+        bool compiled = false;
+    };
+
+    std::string describe(const Document::Statistics& statistics)
+    {
+        std::ostringstream oss;
+        oss << statistics.statements << " statements, " << statistics.reparsed << " reparsed, " << statistics.resolved << " resolved, "
+            << statistics.lowered << " lowered in " << std::fixed << std::setprecision(2) << statistics.milliseconds << "ms\n";
+        return oss.str();
+    }
+
+    // Returns false once the server should stop
+    bool serve(Connection& connection, std::unordered_map<std::string, OpenFile>& files, const Driver::Options& options)
+    {
+        std::string line;
+        while(connection.readLine(line))
+        {
+            std::istringstream request(line);
+            std::string command, name;
+            request >> command >> name;
+
+            if(command == "shutdown")
+            {
+                connection.reply(true, "");
+                return false;
+            }
+
+            if(command == "open")
+            {
+                auto& file = files[name];
+                try
+                {
+                    file.document = std::make_unique<Document>(Driver::readSource(name), options.lineBuffered, options.maxNesting);
+                }
+                catch(std::exception& e)
+                {
+                    files.erase(name);
+                    connection.reply(false, std::string(e.what()) + "\n");
+                    continue;
+                }
+
+                std::ostringstream diagnostics;
+                file.compiled = file.document->compile(diagnostics);
+                connection.reply(file.compiled, file.compiled ? describe(file.document->getStatistics()) : diagnostics.str());
+                continue;
+            }
+
+            auto file = files.find(name);
+            if(file == files.end())
+            {
+                if(command == "edit") break;   // the rest of the stream can not be framed without knowing the request
+                connection.reply(false, "No open file named '" + name + "'\n");
+                continue;
+            }
+
+            if(command == "edit")
+            {
+                unsigned firstLine, lineCount;
+                std::size_t length;
+                std::string replacement;
+                if(!(request >> firstLine >> lineCount >> length) || !connection.readBytes(length, replacement)) break;
+
+                std::ostringstream diagnostics;
+                file->second.compiled = file->second.document->edit(firstLine, lineCount, replacement, diagnostics);
+                connection.reply(file->second.compiled, file->second.compiled ? describe(file->second.document->getStatistics()) : diagnostics.str());
+            }
+            else if(command == "build")
+            {
+                if(!file->second.compiled)
+                {
+                    connection.reply(false, name + ".ling has compilation errors\n");
+                    continue;
+                }
+
+                try
+                {
+                    auto& assembly = file->second.document->getAssembly();
+                    if(options.fullCompile) connection.reply(true, CodeGen::buildExecutable(assembly, name));
+                    else
+                    {
+                        std::ofstream output(name + ".asm");
+                        output << assembly;
+                        output.close();
+                        if(!output) throw std::runtime_error("Cannot write " + name + ".asm");
+                        connection.reply(true, "");
+                    }
+                }
+                catch(std::exception& e)
+                {
+                    connection.reply(false, std::string(e.what()) + "\n");
+                }
+            }
+            else if(command == "close")
+            {
+                files.erase(file);
+                connection.reply(true, "");
+            }
+            else connection.reply(false, "Unknown request '" + command + "'\n");
+        }
+
+        return true;
+    }
+}
+
+int Server::run(const std::string &socketPath, const Driver::Options &options)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if(socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path too long: " << socketPath << "\n";
+        return -1;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listener < 0)
+    {
+        std::cerr << "Cannot create socket: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+
+    // only a socket left behind by an earlier server is replaced, never a file named by mistake
+    struct stat existing;
+    if(lstat(socketPath.c_str(), &existing) == 0)
+    {
+        if(!S_ISSOCK(existing.st_mode))
+        {
+            std::cerr << "Cannot listen on " << socketPath << ": the path exists and is not a socket\n";
+            close(listener);
+            return -1;
+        }
+        unlink(socketPath.c_str());
+    }
+
+    struct stat bound;
+    if(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 8) != 0
+       || lstat(socketPath.c_str(), &bound) != 0)
+    {
+        std::cerr << "Cannot listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+        close(listener);
+        return -1;
+    }
+
+    std::unordered_map<std::string, OpenFile> files;
+    for(bool running = true; running;)
+    {
+        int descriptor = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if(descriptor < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "Cannot accept connection: " << std::strerror(errno) << "\n";
+            break;
+        }
+
+        Connection connection(descriptor);
+        running = serve(connection, files, options);
+    }
+
+    close(listener);
+
+    // another server may have replaced the socket in the meantime
+    struct stat current;
+    if(lstat(socketPath.c_str(), &current) == 0 && current.st_dev == bound.st_dev && current.st_ino == bound.st_ino)
+        unlink(socketPath.c_str());
+    return 0;
+}
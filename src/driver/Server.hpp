@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Driver.hpp"
+#include <string>
+
+/**
+ *  Long-lived compile server for editor integrations, listening on a Unix socket. A socket left
+ *  at the path by an earlier server is replaced; any other existing file makes run fail.
+ *
+ *  Requests are single lines, answered with "ok <length>\n" or "error <length>\n" followed by
+ *  length bytes of text:
+ *
+ *      open <name>                             compiles <name>.ling and keeps it open
+ *      edit <name> <line> <count> <length>     replaces count lines from line (counted from 1)
+ *                                              with the length bytes following the request
+ *      build <name>                            writes the executable, or <name>.asm with -s
+ *      close <name>
+ *      shutdown
+ */
+namespace Server {
+    int run(const std::string& socketPath, const Driver::Options& options);
+};
@@ -0,0 +1,90 @@
+#include "SourceFile.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr std::size_t chunkSize = 1 << 20;
+// token offsets are 32-bit, so a longer stream could not be tokenized anyway
+static constexpr std::size_t reservedSize = std::size_t(1) << 32;
+
+static std::runtime_error readError(const std::string& path, const std::string& reason = std::strerror(errno))
+{
+    return std::runtime_error("Cannot read " + (path == "-" ? std::string("stdin") : path) + ": " + reason);
+}
+
+SourceFile::SourceFile(const std::string& path) : path(path)
+{
+    descriptor = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(descriptor < 0) throw readError(path);
+
+    struct stat status;
+    if(fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+    {
+        void* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if(mapping != MAP_FAILED)
+        {
+            madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+            data = static_cast<char*>(mapping);
+            size = capacity = status.st_size;
+            mapped = true;
+        }
+    }
+}
+
+SourceFile::~SourceFile()
+{
+    if(data) munmap(data, mapped ? capacity : reservedSize);
+    if(descriptor > STDIN_FILENO) close(descriptor);
+}
+
+bool SourceFile::readChunk()
+{
+    if(mapped) return false;
+
+    if(!data)
+    {
+        void* mapping = mmap(nullptr, reservedSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(mapping == MAP_FAILED) throw readError(path);
+        data = static_cast<char*>(mapping);
+    }
+
+    if(capacity - size < chunkSize)
+    {
+        auto newCapacity = std::min(std::max(2 * capacity, size + chunkSize), reservedSize);
+        if(newCapacity == capacity) throw readError(path, "source larger than 4 GiB");
+        if(mprotect(data + capacity, newCapacity - capacity, PROT_READ | PROT_WRITE) != 0) throw readError(path);
+        capacity = newCapacity;
+    }
+
+    for(;;)
+    {
+        auto count = read(descriptor, data + size, capacity - size);
+        if(count > 0)
+        {
+            size += count;
+            return true;
+        }
+        if(count == 0) return false;
+        if(errno != EINTR) throw readError(path);
+    }
+}
+
+std::string_view SourceFile::getText() const
+{
+    return std::string_view(data, size);
+}
+
+bool SourceFile::isMapped() const
+{
+    return mapped;
+}
+
+void SourceFile::readAll()
+{
+    while(readChunk());
+}
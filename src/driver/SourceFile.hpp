@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../frontend/Tokens.hpp"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ *  A program's text, read without an intermediate copy.
+ *
+ *  Regular files are memory-mapped whole. Pipes, terminals and stdin (the path "-") are read in
+ *  chunks into an anonymous mapping: address space for the largest source a token can point into
+ *  is reserved up front and committed chunk by chunk, so the text never moves while it grows and
+ *  a tokenizer thread can hand out views of it as the chunks arrive.
+ */
+class SourceFile : public Tokenization::ChunkedInput {
+public:
+    // Throws if the file can not be opened
+    explicit SourceFile(const std::string& path);
+    ~SourceFile();
+
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    bool readChunk() override;
+    std::string_view getText() const override;
+
+    void readAll();
+
+    // Whether the whole text was available from the start
+    bool isMapped() const;
+
+private:
+    std::string path;
+    int descriptor = -1;
+    bool mapped = false;
+
+    char* data = nullptr;
+    std::size_t size = 0;
+    // committed part of the reservation, or the mapped file's size
+    std::size_t capacity = 0;
+};
@@ -0,0 +1,119 @@
+#include "ThreadPool.hpp"
+
+namespace {
+    struct CurrentWorker {
+        const ThreadPool* pool = nullptr;
+        unsigned index = 0;
+    };
+
+    thread_local CurrentWorker currentWorker;
+}
+
+ThreadPool::ThreadPool(unsigned threadsCount)
+{
+    if(threadsCount == 0) threadsCount = 1;
+
+    for(unsigned i = 0; i < threadsCount; ++i)
+        workers.push_back(std::make_unique<Worker>());
+    for(unsigned i = 0; i < threadsCount; ++i)
+        threads.emplace_back([this, i]() { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::lock_guard lock(stateMutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+
+    for(auto& thread : threads)
+        thread.join();
+}
+
+unsigned ThreadPool::getThreadsCount() const
+{
+    return workers.size();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    unsigned index = currentWorker.pool == this
+        ? currentWorker.index
+        : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+    {
+        std::lock_guard lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(stateMutex);
+        ++queued;
+        ++unfinished;
+    }
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock lock(stateMutex);
+    allDone.wait(lock, [this]() { return unfinished == 0; });
+}
+
+bool ThreadPool::takeTask(unsigned index, std::function<void()> &task)
+{
+    {
+        auto& own = *workers[index];
+        std::lock_guard lock(own.mutex);
+        if(!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for(std::size_t offset = 1; offset < workers.size(); ++offset)
+    {
+        auto& victim = *workers[(index + offset) % workers.size()];
+        std::lock_guard lock(victim.mutex);
+        if(!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+    currentWorker = {this, index};
+
+    for(;;)
+    {
+        {
+            std::unique_lock lock(stateMutex);
+            taskAvailable.wait(lock, [this]() { return queued > 0 || stopping; });
+            if(queued == 0 && stopping) return;
+            --queued;
+        }
+
+        // a task is reserved for this worker, so one of the deques holds it until it is taken
+        std::function<void()> task;
+        while(!takeTask(index, task))
+            std::this_thread::yield();
+
+        task();
+
+        bool finished;
+        {
+            std::lock_guard lock(stateMutex);
+            finished = --unfinished == 0;
+        }
+        if(finished) allDone.notify_all();
+    }
+}
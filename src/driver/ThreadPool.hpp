@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ *  Work-stealing thread pool.
+ *
+ *  Every worker owns a deque. Tasks submitted from a worker go to the back of its own deque and
+ *  are taken from the back again, so follow-up work of a task runs on the same (warm) thread.
+ *  Tasks submitted from outside are spread round-robin. Idle workers steal from the front of
+ *  the other workers' deques.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadsCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task, including tasks submitted by tasks, has finished
+    void wait();
+
+    unsigned getThreadsCount() const;
+
+private:
+    struct Worker {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex stateMutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable allDone;
+    std::size_t queued = 0;
+    std::size_t unfinished = 0;
+    bool stopping = false;
+
+    std::atomic<unsigned> nextWorker = 0;
+
+    void workerLoop(unsigned index);
+    bool takeTask(unsigned index, std::function<void()>& task);
+};
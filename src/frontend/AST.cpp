@@ -1,110 +1,119 @@
 #include "AST.hpp"
+#include "Interner.hpp"
 #include <stdexcept>
 #include <charconv>
+#include <utility>
+#include <vector>
 
-AST::Statement::~Statement() = default;
-AST::Expression::~Expression() = default;
-AST::VariableData::~VariableData() = default;
-
-AST::VariableData::VariableData(const Tokenization::Token &token)
-    : token(token) {}
-
-AST::VariableDeclaration::VariableDeclaration(const Tokenization::Token& token, std::unique_ptr<Expression> value)
-    : AST::VariableData(token), identificator(token.value), value(std::move(value))
+std::optional<int> AST::Expression::getValue() const
 {
-    if(identificator.empty())
-        throw std::invalid_argument("Cannot declare a variable with empty identificator");
+    // Folded bottom-up on explicit stacks: an operation is pushed again under its operands
+    std::vector<std::pair<const Expression*, bool>> pending{{this, false}};
+    std::vector<std::optional<int>> values;
+    while(!pending.empty())
+    {
+        auto [expression, operandsDone] = pending.back();
+        pending.pop_back();
+
+        switch(expression->kind)
+        {
+            case Kind::Literal:
+                values.push_back(static_cast<const LiteralValue*>(expression)->value);
+                break;
+            case Kind::Variable:
+                values.push_back(std::nullopt);
+                break;
+            case Kind::BinaryOperation: {
+                auto* binary = static_cast<const BinaryOperation*>(expression);
+                if(!operandsDone)
+                {
+                    pending.push_back({expression, true});
+                    pending.push_back({binary->rightOperand.get(), false});
+                    pending.push_back({binary->leftOperand.get(), false});
+                    break;
+                }
+                auto right = values.back();
+                values.pop_back();
+                auto& left = values.back();
+                if(!left || !right) left.reset();
+                else left = BinaryOperation::operations.at(binary->operation)(*left, *right);
+            } break;
+            case Kind::UnaryOperation: {
+                auto* unary = static_cast<const UnaryOperation*>(expression);
+                if(!operandsDone)
+                {
+                    pending.push_back({expression, true});
+                    pending.push_back({unary->operand.get(), false});
+                    break;
+                }
+                auto& operand = values.back();
+                if(operand) operand = UnaryOperation::operations.at(unary->operation)(*operand);
+            } break;
+        }
+    }
+    return values.back();
 }
 
-std::string AST::VariableDeclaration::getName() const
+AST::VariableData::VariableData(const Tokenization::Token &token)
+    : token(token)
 {
-    return identificator;
+    if(token.type != Tokenization::Token::Type::Identificator)
+        throw std::invalid_argument("Cannot name a variable with a token other than identificator");
 }
 
-AST::VariableAssignment::VariableAssignment(const Tokenization::Token& token, std::unique_ptr<Expression> value)
-    : AST::VariableData(token), identificator(token.value), value(std::move(value))
+uint32_t AST::VariableData::getSymbol() const
 {
-    if(identificator.empty())
-        throw std::invalid_argument("Cannot assign to a variable with empty identificator");
+    return token.symbol;
 }
 
-std::string AST::VariableAssignment::getName() const
+std::string_view AST::VariableData::getName() const
 {
-    return identificator;
+    return Interner::getSpelling(token.symbol);
 }
 
-AST::IfStatement::IfStatement(std::unique_ptr<Expression> condition, std::unique_ptr<Statement> body)
-    : condition(std::move(condition)), body(std::move(body))
+AST::VariableDeclaration::VariableDeclaration(const Tokenization::Token& token, Ptr<Expression> value)
+    : AST::Statement(Kind::VariableDeclaration), AST::VariableData(token), value(std::move(value))
+{}
+
+AST::VariableAssignment::VariableAssignment(const Tokenization::Token& token, Ptr<Expression> value)
+    : AST::Statement(Kind::VariableAssignment), AST::VariableData(token), value(std::move(value))
+{}
+
+AST::IfStatement::IfStatement(Ptr<Expression> condition, Ptr<Statement> body)
+    : AST::Statement(Kind::If), condition(std::move(condition)), body(std::move(body))
 {}
 
-AST::WhileStatement::WhileStatement(std::unique_ptr<Expression> condition, std::unique_ptr<Statement> body)
-    : condition(std::move(condition)), body(std::move(body))
+AST::WhileStatement::WhileStatement(Ptr<Expression> condition, Ptr<Statement> body)
+    : AST::Statement(Kind::While), condition(std::move(condition)), body(std::move(body))
 {}
 
-AST::DisplayStatement::DisplayStatement(std::unique_ptr<Expression> expression)
-    : expression(std::move(expression)) {}
+AST::DisplayStatement::DisplayStatement(Ptr<Expression> expression)
+    : AST::Statement(Kind::Display), expression(std::move(expression)) {}
 
 AST::LiteralValue::LiteralValue(std::string_view value)
+    : AST::Expression(Kind::Literal)
 {
     std::from_chars(value.data(), value.data() + value.size(), this->value);
 }
 
-std::optional<int> AST::LiteralValue::getValue() const
-{
-    return value;
-}
-
 AST::VariableValue::VariableValue(const Tokenization::Token& token)
-    : AST::VariableData(token), identificator(token.value)
+    : AST::Expression(Kind::Variable), AST::VariableData(token)
 {}
 
-std::optional<int> AST::VariableValue::getValue() const
-{
-    return std::optional<int>();
-}
-
-std::string AST::VariableValue::getName() const
-{
-    return identificator;
-}
-
-AST::BinaryOperation::BinaryOperation(OperationType operation, std::unique_ptr<Expression> leftOperand, std::unique_ptr<Expression> rightOperand)
-    : operation(operation), leftOperand(std::move(leftOperand)), rightOperand(std::move(rightOperand))
+AST::BinaryOperation::BinaryOperation(OperationType operation, Ptr<Expression> leftOperand, Ptr<Expression> rightOperand)
+    : AST::Expression(Kind::BinaryOperation), operation(operation), leftOperand(std::move(leftOperand)), rightOperand(std::move(rightOperand))
 {}
 
-std::optional<int> AST::BinaryOperation::getValue() const
-{
-    auto leftValue = leftOperand->getValue();
-    auto rightValue = rightOperand->getValue();
-
-    if(!leftValue.has_value() || !rightValue.has_value()) return std::optional<int>();
-    if(!operations.contains(operation)) throw std::runtime_error("Invalid binary operation type");
-
-    auto operationLambda = operations.at(operation);
-    return operationLambda(leftValue.value(), rightValue.value());
-}
-
-AST::UnaryOperation::UnaryOperation(OperationType operation, std::unique_ptr<Expression> operand)
-    : operation(operation), operand(std::move(operand))
+AST::UnaryOperation::UnaryOperation(OperationType operation, Ptr<Expression> operand)
+    : AST::Expression(Kind::UnaryOperation), operation(operation), operand(std::move(operand))
 {}
 
-std::optional<int> AST::UnaryOperation::getValue() const
-{
-    auto operandValue = operand->getValue();
-    if(!operandValue.has_value()) return std::optional<int>();
-    if(!operations.contains(operation)) throw std::runtime_error("Invalid unary operation type");
-
-    auto operationLambda = operations.at(operation);
-    return operationLambda(operandValue.value());
-}
-
-AST::CodeBlock::CodeBlock(std::vector<std::unique_ptr<Statement>> block)
-    : block(std::move(block)) {}
+AST::CodeBlock::CodeBlock(std::span<Ptr<Statement>> block)
+    : AST::Statement(Kind::CodeBlock), block(std::move(block)) {}
 
 void AST::VariableData::resolve(unsigned offset)
 {
-    if(resolved) return;
-
+    // statements kept by the compile server are resolved again when the declarations before them change
     this->offset = offset;
     resolved = true;
 }
@@ -4,24 +4,56 @@
 #include <optional>
 #include <unordered_map>
 #include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <span>
+#include "Arena.hpp"
 #include "Tokens.hpp"
 
 namespace AST {
 
     // ===== Base classes =====
-    struct Statement { virtual ~Statement() = 0; };
+    // Nodes are allocated in an Arena, see Arena.hpp, and passes dispatch on their kind with AST::visit
+    struct Statement {
+        enum class Kind : uint8_t {
+            VariableDeclaration,
+            VariableAssignment,
+            If,
+            While,
+            Display,
+            CodeBlock
+        };
+
+        const Kind kind;
+
+    protected:
+        explicit Statement(Kind kind) : kind(kind) {}
+    };
     struct Expression {
-        virtual ~Expression() = 0;
-        virtual std::optional<int> getValue() const = 0;
+        enum class Kind : uint8_t {
+            Literal,
+            Variable,
+            BinaryOperation,
+            UnaryOperation
+        };
+
+        const Kind kind;
+
+        // The value of a constant expression
+        std::optional<int> getValue() const;
+
+    protected:
+        explicit Expression(Kind kind) : kind(kind) {}
     };
     struct VariableData {
-        virtual ~VariableData() = 0;
         explicit VariableData(const Tokenization::Token& token); 
 
         unsigned offset = 0;
         bool resolved = false;
         
-        virtual std::string getName() const = 0;
+        // the interned spelling, names are compared by symbol
+        uint32_t getSymbol() const;
+        std::string_view getName() const;
         void resolve(unsigned offset);
     
         const Tokenization::Token& token;
@@ -29,48 +61,42 @@ namespace AST {
 
     // ===== Statements =====
     struct VariableDeclaration : public Statement, public VariableData {
-        VariableDeclaration(const Tokenization::Token& identificator, std::unique_ptr<Expression> value);
+        VariableDeclaration(const Tokenization::Token& identificator, Ptr<Expression> value);
         ~VariableDeclaration() = default;
 
-        std::string identificator;
-        std::unique_ptr<Expression> value;
-
-        std::string getName() const override;
+        Ptr<Expression> value;
     };
     struct VariableAssignment : public Statement, public VariableData {
-        VariableAssignment(const Tokenization::Token& identificator, std::unique_ptr<Expression> value);
+        VariableAssignment(const Tokenization::Token& identificator, Ptr<Expression> value);
         ~VariableAssignment() = default;
 
-        std::string identificator;
-        std::unique_ptr<Expression> value;
-
-        std::string getName() const override;
+        Ptr<Expression> value;
     };
     struct IfStatement : public Statement {
-        IfStatement(std::unique_ptr<Expression> condition, std::unique_ptr<Statement> body);
+        IfStatement(Ptr<Expression> condition, Ptr<Statement> body);
         ~IfStatement() = default;
 
-        std::unique_ptr<Expression> condition;
-        std::unique_ptr<Statement> body;
+        Ptr<Expression> condition;
+        Ptr<Statement> body;
     };
     struct WhileStatement : public Statement {
-        WhileStatement(std::unique_ptr<Expression> condition, std::unique_ptr<Statement> body);
+        WhileStatement(Ptr<Expression> condition, Ptr<Statement> body);
         ~WhileStatement() = default;
 
-        std::unique_ptr<Expression> condition;
-        std::unique_ptr<Statement> body;
+        Ptr<Expression> condition;
+        Ptr<Statement> body;
     };
     struct DisplayStatement : public Statement {
-        DisplayStatement(std::unique_ptr<Expression> expression);
+        DisplayStatement(Ptr<Expression> expression);
         ~DisplayStatement() = default;
 
-        std::unique_ptr<Expression> expression;
+        Ptr<Expression> expression;
     };
     struct CodeBlock : public Statement {
-        CodeBlock(std::vector<std::unique_ptr<Statement>> block);
+        CodeBlock(std::span<Ptr<Statement>> block);
         ~CodeBlock() = default;
 
-        std::vector<std::unique_ptr<Statement>> block;
+        std::span<Ptr<Statement>> block;
     };
 
     // ===== Expressions =====
@@ -78,19 +104,11 @@ namespace AST {
         LiteralValue(std::string_view value);
         ~LiteralValue() = default;
 
-        std::optional<int> getValue() const override;
-
         int value;
     };
     struct VariableValue : public Expression, public VariableData {
         VariableValue(const Tokenization::Token& identificator);
         ~VariableValue() = default;
-
-        std::optional<int> getValue() const override;
-
-        std::string identificator;
-
-        std::string getName() const override;
     };
     struct BinaryOperation : public Expression {
         enum class OperationType {
@@ -109,14 +127,12 @@ namespace AST {
             LessEqual
         };
 
-        BinaryOperation(OperationType operation, std::unique_ptr<Expression> leftOperand, std::unique_ptr<Expression> rightOperand);
+        BinaryOperation(OperationType operation, Ptr<Expression> leftOperand, Ptr<Expression> rightOperand);
         ~BinaryOperation() = default;
 
-        std::optional<int> getValue() const override;
-
         OperationType operation;
-        std::unique_ptr<Expression> leftOperand;
-        std::unique_ptr<Expression> rightOperand;
+        Ptr<Expression> leftOperand;
+        Ptr<Expression> rightOperand;
     
         inline static const std::unordered_map<OperationType, std::function<int(int, int)>> operations = {{
             {OperationType::Addition,       [](int a, int b) { return a + b; }},
@@ -141,13 +157,11 @@ namespace AST {
             Not
         };
 
-        UnaryOperation(OperationType operation, std::unique_ptr<Expression> operand);
+        UnaryOperation(OperationType operation, Ptr<Expression> operand);
         ~UnaryOperation() = default;
 
-        std::optional<int> getValue() const override;
-
         OperationType operation;
-        std::unique_ptr<Expression> operand;
+        Ptr<Expression> operand;
 
         inline static const std::unordered_map<OperationType, std::function<int(int)>> operations = {{
             {OperationType::Identity,   [](int a) { return a; }},
@@ -155,4 +169,41 @@ namespace AST {
             {OperationType::Not,        [](int a) { return !a; }}
         }};
     };
-};
\ No newline at end of file
+
+    template<class Node, class Base>
+    using SameConstness = std::conditional_t<std::is_const_v<Base>, const Node, Node>;
+
+    /**
+     *  Calls visitor with the node cast to its concrete type, found by the node's kind rather than
+     *  RTTI; like std::visit, the visitor has an overload for every statement or expression type.
+     */
+    template<class Visitor, class Base>
+        requires std::is_same_v<std::remove_const_t<Base>, Statement>
+    decltype(auto) visit(Visitor&& visitor, Base& statement)
+    {
+        switch(statement.kind)
+        {
+            case Statement::Kind::VariableDeclaration: return visitor(static_cast<SameConstness<VariableDeclaration, Base>&>(statement));
+            case Statement::Kind::VariableAssignment: return visitor(static_cast<SameConstness<VariableAssignment, Base>&>(statement));
+            case Statement::Kind::If: return visitor(static_cast<SameConstness<IfStatement, Base>&>(statement));
+            case Statement::Kind::While: return visitor(static_cast<SameConstness<WhileStatement, Base>&>(statement));
+            case Statement::Kind::Display: return visitor(static_cast<SameConstness<DisplayStatement, Base>&>(statement));
+            case Statement::Kind::CodeBlock: return visitor(static_cast<SameConstness<CodeBlock, Base>&>(statement));
+        }
+        throw std::invalid_argument("Unrecognized statement");
+    }
+
+    template<class Visitor, class Base>
+        requires std::is_same_v<std::remove_const_t<Base>, Expression>
+    decltype(auto) visit(Visitor&& visitor, Base& expression)
+    {
+        switch(expression.kind)
+        {
+            case Expression::Kind::Literal: return visitor(static_cast<SameConstness<LiteralValue, Base>&>(expression));
+            case Expression::Kind::Variable: return visitor(static_cast<SameConstness<VariableValue, Base>&>(expression));
+            case Expression::Kind::BinaryOperation: return visitor(static_cast<SameConstness<BinaryOperation, Base>&>(expression));
+            case Expression::Kind::UnaryOperation: return visitor(static_cast<SameConstness<UnaryOperation, Base>&>(expression));
+        }
+        throw std::invalid_argument("Unrecognized expression");
+    }
+};
@@ -0,0 +1,40 @@
+#include "Arena.hpp"
+#include <algorithm>
+
+// Blocks double from the first size up to the last, so small programs stay small and large ones need few blocks
+static constexpr std::size_t firstBlockSize = 16 << 10;
+static constexpr std::size_t lastBlockSize = 4 << 20;
+
+void* AST::Arena::allocateBlock(std::size_t size, std::size_t alignment)
+{
+    // a block freed by rewind comes first, if the allocation fits in it
+    if(current && block + 1 < blocks.size() && blocks[block + 1].size >= size + alignment)
+    {
+        ++block;
+        current = blocks[block].data.get();
+        capacity = blocks[block].size;
+        used = 0;
+        return allocate(size, alignment);
+    }
+
+    auto blockSize = std::clamp(2 * capacity, firstBlockSize, lastBlockSize);
+    blockSize = std::max(blockSize, size + alignment);
+
+    // free blocks too small for it are dropped, so the blocks stay in use order
+    if(current) blocks.resize(++block);
+    blocks.push_back({std::make_unique_for_overwrite<std::byte[]>(blockSize), blockSize});
+    block = blocks.size() - 1;
+    current = blocks.back().data.get();
+    capacity = blockSize;
+    used = 0;
+    return allocate(size, alignment);
+}
+
+void AST::Arena::rewind(Mark mark)
+{
+    if(blocks.empty()) return;
+    block = mark.block;
+    current = blocks[block].data.get();
+    capacity = blocks[block].size;
+    used = mark.used;
+}
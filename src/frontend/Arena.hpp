@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace AST {
+    // Nodes are freed with their Arena, a pointer to a node only expresses the tree's structure
+    struct ArenaDelete {
+        void operator()(const void*) const noexcept {}
+    };
+    template<class T>
+    using Ptr = std::unique_ptr<T, ArenaDelete>;
+
+    /**
+     *  Bump allocator that owns the nodes of one parse, placed one after another in parse order.
+     *  Its blocks are released together without running destructors, so a node must not own
+     *  memory outside the arena: child lists are spans allocated here as well.
+     */
+    class Arena {
+    public:
+        Arena() = default;
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(std::size_t size, std::size_t alignment)
+        {
+            auto padding = -reinterpret_cast<std::uintptr_t>(current + used) & (alignment - 1);
+            if(used + padding + size > capacity) return allocateBlock(size, alignment);
+            auto address = current + used + padding;
+            used += padding + size;
+            return address;
+        }
+
+        template<class T, class... Args>
+        Ptr<T> make(Args&&... args)
+        {
+            return Ptr<T>(new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...));
+        }
+
+        // Moves the items into the arena
+        template<class T>
+        std::span<T> makeSpan(std::span<T> items)
+        {
+            if(items.empty()) return {};
+            auto first = static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+            std::uninitialized_move(items.begin(), items.end(), first);
+            return {first, items.size()};
+        }
+
+        struct Mark {
+            std::size_t block;
+            std::size_t used;
+        };
+
+        /**
+         *  Everything allocated after getMark is given back by rewind and its blocks are reused, so
+         *  nodes that are dropped one statement at a time take no more memory than the largest one.
+         *  The caller guarantees nothing refers to those nodes any more.
+         */
+        Mark getMark() const { return {block, used}; }
+        void rewind(Mark mark);
+
+    private:
+        struct Block {
+            std::unique_ptr<std::byte[]> data;
+            std::size_t size;
+        };
+
+        std::vector<Block> blocks;
+        // index of the block allocations are made from, blocks after it are free
+        std::size_t block = 0;
+        std::byte* current = nullptr;
+        std::size_t used = 0;
+        std::size_t capacity = 0;
+
+        void* allocateBlock(std::size_t size, std::size_t alignment);
+    };
+};
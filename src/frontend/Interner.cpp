@@ -0,0 +1,48 @@
+#include "Interner.hpp"
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace {
+    struct Table {
+        std::shared_mutex mutex;
+        // a deque never moves its elements, so the map can key on views of them
+        std::deque<std::string> spellings{""};
+        std::unordered_map<std::string_view, uint32_t> symbols{{spellings.front(), 0}};
+    };
+
+    Table& getTable()
+    {
+        static Table table;
+        return table;
+    }
+}
+
+uint32_t Interner::intern(std::string_view spelling)
+{
+    auto& table = getTable();
+    {
+        std::shared_lock lock(table.mutex);
+        auto it = table.symbols.find(spelling);
+        if(it != table.symbols.end()) return it->second;
+    }
+
+    std::unique_lock lock(table.mutex);
+    auto it = table.symbols.find(spelling);
+    if(it != table.symbols.end()) return it->second;
+
+    auto symbol = static_cast<uint32_t>(table.spellings.size());
+    table.symbols.emplace(table.spellings.emplace_back(spelling), symbol);
+    return symbol;
+}
+
+std::string_view Interner::getSpelling(uint32_t symbol)
+{
+    auto& table = getTable();
+    std::shared_lock lock(table.mutex);
+    if(symbol >= table.spellings.size()) throw std::out_of_range("Unknown symbol");
+    return table.spellings[symbol];
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+/**
+ *  Process-wide table of identificator spellings, shared by the tokenizer, the parser and the
+ *  symbol table so that names are compared as integers. Symbols are never released and stay
+ *  valid for the whole run; 0 is the empty spelling. Safe to use from several threads.
+ */
+namespace Interner {
+    uint32_t intern(std::string_view spelling);
+    std::string_view getSpelling(uint32_t symbol);
+};
@@ -1,11 +1,7 @@
 #include "Parser.hpp"
-#include <stack>
-#include <deque>
-#include <unordered_map>
-#include <unordered_set>
+#include <array>
 #include <utility>
 #include <iostream>
-#include <initializer_list>
 #include <sstream>
 
 /**
@@ -31,315 +27,439 @@
  *  
  */
 
-inline static void checkNextToken(const std::vector<Token>& tokens, std::vector<Token>::const_iterator& it, Token::Type expectedToken)
+Parser::VectorCursor::VectorCursor(const std::vector<Token>& tokens) : first(tokens.data())
+{
+    current = tokens.data();
+    end = tokens.data() + tokens.size();
+}
+
+std::size_t Parser::VectorCursor::getPosition() const
+{
+    return current - first;
+}
+
+const Token& Parser::VectorCursor::keep()
+{
+    return *current;
+}
+
+bool Parser::VectorCursor::refill()
+{
+    return false;
+}
+
+Parser::StreamCursor::StreamCursor(TokenStream& stream, std::deque<Token>& kept) : stream(stream), kept(kept) {}
+
+Parser::StreamCursor::~StreamCursor()
+{
+    stream.release(windowSize);
+}
+
+const Token& Parser::StreamCursor::keep()
+{
+    return kept.emplace_back(*current);
+}
+
+bool Parser::StreamCursor::refill()
+{
+    stream.release(windowSize);
+    auto window = stream.acquire();
+    current = window.data();
+    end = window.data() + window.size();
+    windowSize = window.size();
+    return !window.empty();
+}
+
+inline static void checkNextToken(Parser::TokenCursor& cursor, Token::Type expectedToken)
 {
-    auto end = tokens.end();
     std::ostringstream oss;
-    if(it + 1 == end) {
-        oss << "Structure not met (end of tokens where token was expected)\n" << *it;
+    cursor.advance();
+    if(cursor.atEnd()) {
+        oss << "Structure not met (end of tokens where token was expected)\n" << cursor.getPrevious();
         throw std::runtime_error(oss.str());
     }
-    ++it;
-    if(it->type != expectedToken) {
-        oss << "Structure not met (token doesn\'t match the expected token)\n" << *it << "\nExpected: " << expectedToken << "\nGot: " << it->type;
+    if(cursor.get().type != expectedToken) {
+        oss << "Structure not met (token doesn\'t match the expected token)\n" << cursor.get() << "\nExpected: " << expectedToken << "\nGot: " << cursor.get().type;
         throw std::runtime_error(oss.str());
     }
 }
 
-std::unique_ptr<Statement> parseStatement(const std::vector<Token> &tokens, std::vector<Token>::const_iterator &it)
+static std::runtime_error endOfTokensError(const Parser::TokenCursor& cursor)
 {
-    auto checkNext = [tokens, &it](Token::Type expectedType)
-    { checkNextToken(tokens, it, expectedType); };
+    return std::runtime_error("Structure not met (end of tokens where token was expected)\n" + cursor.getPrevious().getErrorLine());
+}
 
-    switch (it->type)
+void Parser::TokenCursor::enterNesting()
+{
+    if(nesting == nestingLimit)
+    {
+        std::ostringstream oss;
+        oss << "Nesting too deep (more than " << nestingLimit << " levels)\n" << get();
+        throw std::runtime_error(oss.str());
+    }
+    ++nesting;
+}
+
+/**
+ *  Statements nest through the bodies of if and while and through code blocks. Instead of recursing,
+ *  the parser keeps the statements still open on a stack: it descends to a simple statement, which
+ *  then completes the open statements around it up to a code block that goes on with its next one.
+ */
+namespace {
+    struct OpenStatement {
+        // KeywordIf, KeywordWhile or BraceLeft
+        Token::Type type;
+        Ptr<Expression> condition;
+        // of a code block, where its statements start in the list shared by all the open blocks
+        std::size_t firstStatement = 0;
+    };
+}
+
+// Moves past a statement inside a code block, like parseNextStatement
+static bool blockContinues(Parser::TokenCursor& cursor)
+{
+    if(cursor.atEnd()) throw endOfTokensError(cursor);
+    cursor.advance();
+    return !cursor.atEnd() && cursor.get().type != Token::Type::BraceRight;
+}
+
+static Ptr<Statement> closeBlock(Parser::TokenCursor& cursor, Arena& arena, std::vector<OpenStatement>& open, std::vector<Ptr<Statement>>& blockStatements)
+{
+    auto first = open.back().firstStatement;
+    auto block = arena.makeSpan(std::span(blockStatements).subspan(first));
+    blockStatements.resize(first);
+    open.pop_back();
+    cursor.leaveNesting();
+    return arena.make<CodeBlock>(block);
+}
+
+// A complete statement, or nullptr after opening one whose body comes next
+static Ptr<Statement> beginStatement(Parser::TokenCursor& cursor, Arena& arena, std::vector<OpenStatement>& open, std::vector<Ptr<Statement>>& blockStatements)
+{
+    auto checkNext = [&cursor](Token::Type expectedType)
+    { checkNextToken(cursor, expectedType); };
+
+    if(cursor.atEnd()) throw endOfTokensError(cursor);
+
+    switch (cursor.get().type)
     {
         case Token::Type::KeywordLet: {
             checkNext(Token::Type::Identificator);
-            const auto& identificator = *it;
+            const auto& identificator = cursor.keep();
             checkNext(Token::Type::OperatorAssign);
-            ++it;
-            auto value = Parser::parseExpression(tokens, it, Token::Type::EndOfLine);
-            return std::make_unique<VariableDeclaration>(identificator, std::move(value));
+            cursor.advance();
+            auto value = Parser::parseExpression(cursor, arena, Token::Type::EndOfLine);
+            return arena.make<VariableDeclaration>(identificator, std::move(value));
         } break;
         case Token::Type::Identificator: {
-            const Tokenization::Token& identificator = *it;
+            const Tokenization::Token& identificator = cursor.keep();
             checkNext(Token::Type::OperatorAssign);
-            ++it;
-            auto value = Parser::parseExpression(tokens, it, Token::Type::EndOfLine);
-            return std::make_unique<VariableAssignment>(identificator, std::move(value));
-        } break;
-        case Token::Type::KeywordIf: {
-            std::advance(it, 2);
-            auto condition = Parser::parseExpression(tokens, it);
-            ++it;
-            auto body = parseStatement(tokens, it);
-            return std::make_unique<IfStatement>(std::move(condition), std::move(body));
+            cursor.advance();
+            auto value = Parser::parseExpression(cursor, arena, Token::Type::EndOfLine);
+            return arena.make<VariableAssignment>(identificator, std::move(value));
         } break;
+        case Token::Type::KeywordIf:
         case Token::Type::KeywordWhile: {
-            std::advance(it, 2);
-            auto condition = Parser::parseExpression(tokens, it);
-            ++it;
-            auto body = parseStatement(tokens, it);
-            return std::make_unique<WhileStatement>(std::move(condition), std::move(body));
+            auto type = cursor.get().type;
+            cursor.enterNesting();
+            cursor.advance();
+            cursor.advance();
+            auto condition = Parser::parseExpression(cursor, arena);
+            cursor.advance();
+            open.push_back({type, std::move(condition)});
+            return nullptr;
         } break;
         case Token::Type::KeywordDisplay: {
-            ++it;
-            auto expression = Parser::parseExpression(tokens, it, Token::Type::EndOfLine);
-            return std::make_unique<DisplayStatement>(std::move(expression));
+            cursor.advance();
+            auto expression = Parser::parseExpression(cursor, arena, Token::Type::EndOfLine);
+            return arena.make<DisplayStatement>(std::move(expression));
         } break;
         case Token::Type::BraceLeft: {
-            ++it;
-            auto body = Parser::parseTokens(tokens, it);
-            return std::make_unique<CodeBlock>(std::move(body));
+            cursor.enterNesting();
+            cursor.advance();
+            open.push_back({Token::Type::BraceLeft, nullptr, blockStatements.size()});
+            if(cursor.atEnd() || cursor.get().type == Token::Type::BraceRight) return closeBlock(cursor, arena, open, blockStatements);
+            return nullptr;
         } break;
         default: {
             std::ostringstream oss;
-            oss << "Invalid statement\n" << *it;
+            oss << "Invalid statement\n" << cursor.get();
             throw std::runtime_error(oss.str());
         }
     }
 }
 
-std::vector<std::unique_ptr<Statement>> Parser::parseTokens(const std::vector<Token> &tokens, std::vector<Token>::const_iterator& it)
+Ptr<Statement> Parser::parseStatement(TokenCursor& cursor, Arena& arena)
 {
-    std::vector<std::unique_ptr<Statement>> out;
+    std::vector<OpenStatement> open;
+    std::vector<Ptr<Statement>> blockStatements;
 
-    while(it != tokens.end())
+    for(;;)
     {
-        if(it->type == Token::Type::BraceRight) return out;
-        out.push_back(std::move(parseStatement(tokens, it)));
-        ++it;
+        auto statement = beginStatement(cursor, arena, open, blockStatements);
+        while(statement)
+        {
+            if(open.empty()) return statement;
+
+            auto& parent = open.back();
+            if(parent.type == Token::Type::BraceLeft)
+            {
+                blockStatements.push_back(std::move(statement));
+                if(blockContinues(cursor)) break;
+                statement = closeBlock(cursor, arena, open, blockStatements);
+                continue;
+            }
+
+            if(parent.type == Token::Type::KeywordIf) statement = arena.make<IfStatement>(std::move(parent.condition), std::move(statement));
+            else statement = arena.make<WhileStatement>(std::move(parent.condition), std::move(statement));
+            open.pop_back();
+            cursor.leaveNesting();
+        }
     }
+}
 
+std::vector<Ptr<Statement>> Parser::parseTokens(TokenCursor& cursor, Arena& arena)
+{
+    std::vector<Ptr<Statement>> out;
+    while(auto statement = parseNextStatement(cursor, arena))
+        out.push_back(std::move(statement));
     return out;
 }
 
-inline static const std::unordered_map<Token::Type, unsigned> binaryOperatorsPrecedence = {{
-    {Token::Type::OperatorPlus, 4},
-    {Token::Type::OperatorMinus, 4},
-    {Token::Type::OperatorSlash, 5},
-    {Token::Type::OperatorStar, 5},
-    {Token::Type::OperatorPercent, 5},
-    {Token::Type::OperatorAND, 1},
-    {Token::Type::OperatorOR, 0},
-    {Token::Type::ComparatorEquals, 2},
-    {Token::Type::ComparatorNotEquals, 2},
-    {Token::Type::ComparatorGreaterEqual, 3},
-    {Token::Type::ComparatorGreaterThan, 3},
-    {Token::Type::ComparatorLessEqual, 3},
-    {Token::Type::ComparatorLessThan, 3}
-}};
-
-inline static const std::unordered_map<Token::Type, unsigned> unaryOperatorsPrecedence = {{
-    {Token::Type::OperatorPlus, 6},
-    {Token::Type::OperatorMinus, 6},
-    {Token::Type::OperatorNOT, 6}
-}};
-
-static unsigned getPrecedence(Token::Type type, Parser::OperatorArity arity)
+Ptr<Statement> Parser::parseNextStatement(TokenCursor& cursor, Arena& arena)
+{
+    if(cursor.atEnd() || cursor.get().type == Token::Type::BraceRight) return nullptr;
+
+    auto statement = parseStatement(cursor, arena);
+    if(cursor.atEnd()) throw endOfTokensError(cursor);
+    cursor.advance();
+    return statement;
+}
+
+/**
+ *  Expressions are parsed by precedence climbing (a Pratt parser): a prefix expression followed by
+ *  binary operators, each of which parses its right operand with the next higher precedence, so
+ *  every operator keeps to the left. Unary operators bind tighter than any binary one.
+ */
+static constexpr std::size_t tokenTypesCount = static_cast<std::size_t>(Token::Type::BraceRight) + 1;
+
+static constexpr std::size_t toIndex(Token::Type type)
 {
-    switch(arity)
+    return static_cast<std::size_t>(type);
+}
+
+// Of each token type used as a binary operator, -1 for the others
+static constexpr auto binaryPrecedence = [] {
+    std::array<int, tokenTypesCount> table{};
+    table.fill(-1);
+    table[toIndex(Token::Type::OperatorOR)] = 0;
+    table[toIndex(Token::Type::OperatorAND)] = 1;
+    table[toIndex(Token::Type::ComparatorEquals)] = 2;
+    table[toIndex(Token::Type::ComparatorNotEquals)] = 2;
+    table[toIndex(Token::Type::ComparatorGreaterEqual)] = 3;
+    table[toIndex(Token::Type::ComparatorGreaterThan)] = 3;
+    table[toIndex(Token::Type::ComparatorLessEqual)] = 3;
+    table[toIndex(Token::Type::ComparatorLessThan)] = 3;
+    table[toIndex(Token::Type::OperatorPlus)] = 4;
+    table[toIndex(Token::Type::OperatorMinus)] = 4;
+    table[toIndex(Token::Type::OperatorSlash)] = 5;
+    table[toIndex(Token::Type::OperatorStar)] = 5;
+    table[toIndex(Token::Type::OperatorPercent)] = 5;
+    return table;
+}();
+
+static constexpr BinaryOperation::OperationType getBinaryOperation(Token::Type type)
+{
+    switch(type)
     {
-        case Parser::OperatorArity::Unary: {
-            if(!unaryOperatorsPrecedence.contains(type))
-                throw std::invalid_argument("Token is not an unary operator");
-            return unaryOperatorsPrecedence.at(type);
-        }
-        case Parser::OperatorArity::Binary: {
-            if(!binaryOperatorsPrecedence.contains(type))
-                throw std::invalid_argument("Token is not a binary operator");
-            return binaryOperatorsPrecedence.at(type);
-        }
-        default:
-            throw std::invalid_argument("Invalid arity for precedence calculation");
+        case Token::Type::OperatorPlus: return BinaryOperation::OperationType::Addition;
+        case Token::Type::OperatorMinus: return BinaryOperation::OperationType::Subtraction;
+        case Token::Type::OperatorStar: return BinaryOperation::OperationType::Multiplication;
+        case Token::Type::OperatorSlash: return BinaryOperation::OperationType::Division;
+        case Token::Type::OperatorPercent: return BinaryOperation::OperationType::Modulo;
+        case Token::Type::OperatorAND: return BinaryOperation::OperationType::And;
+        case Token::Type::OperatorOR: return BinaryOperation::OperationType::Or;
+        case Token::Type::ComparatorEquals: return BinaryOperation::OperationType::Equals;
+        case Token::Type::ComparatorNotEquals: return BinaryOperation::OperationType::NotEquals;
+        case Token::Type::ComparatorGreaterEqual: return BinaryOperation::OperationType::GreaterEqual;
+        case Token::Type::ComparatorGreaterThan: return BinaryOperation::OperationType::GreaterThan;
+        case Token::Type::ComparatorLessEqual: return BinaryOperation::OperationType::LessEqual;
+        case Token::Type::ComparatorLessThan: return BinaryOperation::OperationType::LessThan;
+        default: throw std::invalid_argument("Token is not a binary operator");
     }
 }
 
-static std::deque<std::pair<std::vector<Token>::const_iterator, std::optional<Parser::OperatorArity>>> convertToOnp(const std::vector<Token> &tokens, std::vector<Token>::const_iterator& it, Token::Type terminationToken)
+static_assert([] {
+    for(std::size_t i = 0; i < tokenTypesCount; ++i)
+        if(binaryPrecedence[i] >= 0) getBinaryOperation(static_cast<Token::Type>(i));
+    return true;
+}(), "every token with a binary precedence must map to an operation");
+
+// Reports a missing operand at its operator rather than at the token that ends the expression
+static bool endsOperand(Parser::TokenCursor& cursor)
 {
-    std::deque<std::pair<std::vector<Token>::const_iterator, std::optional<Parser::OperatorArity>>> onp;
-    std::stack<std::pair<std::vector<Token>::const_iterator, Parser::OperatorArity>> operatorsStack;
+    if(cursor.atEnd()) return true;
+    auto type = cursor.get().type;
+    return type == Token::Type::EndOfLine || type == Token::Type::ParenthesisRight;
+}
 
-    auto start = it;
+static std::runtime_error missingOperand(const Token& operatorToken)
+{
+    std::ostringstream oss;
+    oss << "Missing operand\n" << operatorToken;
+    return std::runtime_error(oss.str());
+}
 
-    while(it != tokens.end() && it->type != terminationToken)
+static constexpr UnaryOperation::OperationType getUnaryOperation(Token::Type type)
+{
+    switch(type)
     {
-        bool isTerminated = false;
-        switch(it->type)
-        {
-            case Token::Type::Identificator:
-            case Token::Type::Literal: {
-                onp.push_back({it, {}});
-            } break;
-            case Token::Type::OperatorMinus:
-            case Token::Type::OperatorPlus:
-            case Token::Type::OperatorSlash:
-            case Token::Type::OperatorStar:
-            case Token::Type::OperatorPercent:
-            case Token::Type::OperatorAND:
-            case Token::Type::OperatorOR:
-            case Token::Type::OperatorNOT:
-            case Token::Type::ComparatorEquals:
-            case Token::Type::ComparatorGreaterEqual:
-            case Token::Type::ComparatorGreaterThan:
-            case Token::Type::ComparatorLessEqual:
-            case Token::Type::ComparatorLessThan:
-            case Token::Type::ComparatorNotEquals: {
-                auto arity = Parser::getOperatorArity(it, start);
-                auto canPlaceOperator = [&operatorsStack, &it, &arity]() -> bool {
-                    if(operatorsStack.empty()) return true;
-                    
-                    auto top = operatorsStack.top();
-
-                    auto topPrecedence = getPrecedence(top.first->type, top.second);
-                    auto currentPrecedence = getPrecedence(it->type, arity);
-
-                    switch(arity)
-                    {
-                        case Parser::OperatorArity::Unary:
-                            return topPrecedence <= currentPrecedence;
-                        case Parser::OperatorArity::Binary:
-                            return topPrecedence < currentPrecedence;
-                        default:
-                            throw std::invalid_argument("Invalid operator arity");
-                    }
-                };
+        case Token::Type::OperatorPlus: return UnaryOperation::OperationType::Identity;
+        case Token::Type::OperatorMinus: return UnaryOperation::OperationType::Negation;
+        case Token::Type::OperatorNOT: return UnaryOperation::OperationType::Not;
+        default: throw std::invalid_argument("Token is not a unary operator");
+    }
+}
 
-                while(!canPlaceOperator())
-                {
-                    auto top = operatorsStack.top();
-                    operatorsStack.pop();
-                    onp.push_back(top);
-                }
-                operatorsStack.push({it, arity});
-            } break;
-            case Token::Type::ParenthesisLeft: {
-                ++it;
-                auto subExpression = convertToOnp(tokens, it, Token::Type::ParenthesisRight);
-                onp.insert(onp.end(), subExpression.begin(), subExpression.end());
-            } break;
-            default: {
-                if(it->type == terminationToken)
-                {
-                    isTerminated = true;
-                    break;
-                }
-                
-                std::ostringstream oss;
-                oss << "Unexpected token: " << *it;
-                throw std::runtime_error(oss.str());
-            } break;
-        }
+/**
+ *  The parser's recursion is kept on a stack as well. A Binary entry is one level of precedence
+ *  climbing: it holds the left operand parsed so far and, while its right operand is parsed, the
+ *  operator between them. Unary operators and parentheses wait for the operand inside them.
+ */
+namespace {
+    struct OpenExpression {
+        enum class Type {
+            Unary,
+            Parenthesis,
+            Binary
+        } type;
 
-        if(isTerminated) break;
-        ++it;
-    }
+        int minPrecedence = 0;
+        Token operatorToken{};
+        Ptr<Expression> left;
+    };
+}
 
-    while(!operatorsStack.empty())
+// An operand, or nullptr after opening unary operators or a parenthesis that need one first
+static Ptr<Expression> parsePrefix(Parser::TokenCursor& cursor, Arena& arena, std::vector<OpenExpression>& open)
+{
+    if(cursor.atEnd())
     {
-        auto top = operatorsStack.top();
-        operatorsStack.pop();
-        onp.push_back(top);
+        std::ostringstream oss;
+        oss << "Expected expression\n" << cursor.getPrevious();
+        throw std::runtime_error(oss.str());
     }
 
-    return onp;
+    switch(cursor.get().type)
+    {
+        case Token::Type::Identificator: {
+            auto value = arena.make<VariableValue>(cursor.keep());
+            cursor.advance();
+            return value;
+        }
+        case Token::Type::Literal: {
+            auto value = arena.make<LiteralValue>(cursor.get().getText());
+            cursor.advance();
+            return value;
+        }
+        case Token::Type::OperatorPlus:
+        case Token::Type::OperatorMinus:
+        case Token::Type::OperatorNOT: {
+            auto operatorToken = cursor.get();
+            cursor.enterNesting();
+            cursor.advance();
+            if(endsOperand(cursor)) throw missingOperand(operatorToken);
+            open.push_back({OpenExpression::Type::Unary, 0, operatorToken, nullptr});
+            return nullptr;
+        }
+        case Token::Type::ParenthesisLeft: {
+            cursor.enterNesting();
+            cursor.advance();
+            open.push_back({OpenExpression::Type::Parenthesis, 0, {}, nullptr});
+            open.push_back({OpenExpression::Type::Binary, 0, {}, nullptr});
+            return nullptr;
+        }
+        case Token::Type::EndOfLine:
+        case Token::Type::ParenthesisRight: {
+            std::ostringstream oss;
+            oss << "Expected expression\n" << cursor.get();
+            throw std::runtime_error(oss.str());
+        }
+        default: {
+            if(binaryPrecedence[toIndex(cursor.get().type)] >= 0) throw missingOperand(cursor.get());
+
+            std::ostringstream oss;
+            oss << "Unexpected token: " << cursor.get();
+            throw std::runtime_error(oss.str());
+        }
+    }
 }
 
-inline static const std::unordered_map<Token::Type, BinaryOperation::OperationType> binaryOperationTypes = {{
-    {Token::Type::OperatorPlus, BinaryOperation::OperationType::Addition},
-    {Token::Type::OperatorMinus, BinaryOperation::OperationType::Subtraction},
-    {Token::Type::OperatorStar, BinaryOperation::OperationType::Multiplication},
-    {Token::Type::OperatorSlash, BinaryOperation::OperationType::Division},
-    {Token::Type::OperatorPercent, BinaryOperation::OperationType::Modulo},
-    {Token::Type::OperatorAND, BinaryOperation::OperationType::And},
-    {Token::Type::OperatorOR, BinaryOperation::OperationType::Or},
-    {Token::Type::ComparatorEquals, BinaryOperation::OperationType::Equals},
-    {Token::Type::ComparatorNotEquals, BinaryOperation::OperationType::NotEquals},
-    {Token::Type::ComparatorGreaterEqual, BinaryOperation::OperationType::GreaterEqual},
-    {Token::Type::ComparatorGreaterThan, BinaryOperation::OperationType::GreaterThan},
-    {Token::Type::ComparatorLessEqual, BinaryOperation::OperationType::LessEqual},
-    {Token::Type::ComparatorLessThan, BinaryOperation::OperationType::LessThan}
-}};
-
-inline static const std::unordered_map<Token::Type, UnaryOperation::OperationType> unaryOperationTypes = {{
-    {Token::Type::OperatorPlus, UnaryOperation::OperationType::Identity},
-    {Token::Type::OperatorMinus, UnaryOperation::OperationType::Negation},
-    {Token::Type::OperatorNOT, UnaryOperation::OperationType::Not}
-}};
-
-std::unique_ptr<Expression> Parser::parseExpression(const std::vector<Token> &tokens, std::vector<Token>::const_iterator& it, Token::Type terminationToken)
+static Ptr<Expression> parseBinary(Parser::TokenCursor& cursor, Arena& arena)
 {
-    std::stack<std::unique_ptr<Expression>> values;
+    std::vector<OpenExpression> open;
+    open.push_back({OpenExpression::Type::Binary, 0, {}, nullptr});
 
-    auto onpDeque = convertToOnp(tokens, it, terminationToken);
-
-    for(auto pair : onpDeque)
+    for(;;)
     {
-        auto type = pair.first->type;
-        switch(type)
+        auto value = parsePrefix(cursor, arena, open);
+        while(value)
         {
-            case Token::Type::Identificator: {
-                values.push(std::make_unique<VariableValue>(*pair.first));
-            } break;
-            case Token::Type::Literal: {
-                values.push(std::make_unique<LiteralValue>(pair.first->value));
-            } break;
-            default: {
-                switch(pair.second.value())
+            auto& top = open.back();
+            if(top.type == OpenExpression::Type::Unary)
+            {
+                value = arena.make<UnaryOperation>(getUnaryOperation(top.operatorToken.type), std::move(value));
+                open.pop_back();
+                cursor.leaveNesting();
+                continue;
+            }
+
+            if(top.type == OpenExpression::Type::Parenthesis)
+            {
+                // an unclosed '(' ends with the tokens, which the statement reports
+                if(!cursor.atEnd())
                 {
-                    case OperatorArity::Binary: {
-                        auto rightOperand = std::move(values.top());
-                        values.pop();
-                        auto leftOperand = std::move(values.top());
-                        values.pop();
-
-                        if(!binaryOperationTypes.contains(pair.first->type)) throw std::runtime_error("Invalid binary operator");
-                        values.push(std::make_unique<BinaryOperation>(binaryOperationTypes.at(pair.first->type), 
-                            std::move(leftOperand), std::move(rightOperand)));
-                    } break;
-                    case OperatorArity::Unary: {
-                        auto operand = std::move(values.top());
-                        values.pop();
-
-                        if(!unaryOperationTypes.contains(pair.first->type)) throw std::runtime_error("Invalid unary operator");
-                        values.push(std::make_unique<UnaryOperation>(unaryOperationTypes.at(pair.first->type), std::move(operand)));
-                    } break;
+                    if(cursor.get().type != Token::Type::ParenthesisRight)
+                    {
+                        std::ostringstream oss;
+                        oss << "Unexpected token: " << cursor.get();
+                        throw std::runtime_error(oss.str());
+                    }
+                    cursor.advance();
                 }
-            } break;
+                open.pop_back();
+                cursor.leaveNesting();
+                continue;
+            }
+
+            top.left = top.left ? arena.make<BinaryOperation>(getBinaryOperation(top.operatorToken.type), std::move(top.left), std::move(value))
+                                : std::move(value);
+
+            auto precedence = cursor.atEnd() ? -1 : binaryPrecedence[toIndex(cursor.get().type)];
+            if(precedence >= top.minPrecedence)
+            {
+                top.operatorToken = cursor.get();
+                cursor.advance();
+                if(endsOperand(cursor)) throw missingOperand(top.operatorToken);
+                open.push_back({OpenExpression::Type::Binary, precedence + 1, {}, nullptr});
+                break;
+            }
+
+            value = std::move(top.left);
+            open.pop_back();
+            if(open.empty()) return value;
         }
     }
-
-    auto result = std::move(values.top());
-    values.pop();
-    if(!values.empty()) 
-        throw std::runtime_error("Invalid onp convertion");
-    
-    return std::move(result);
 }
 
-inline static const std::unordered_set<Token::Type> operators = {{
-    Token::Type::OperatorMinus,
-    Token::Type::OperatorPlus,
-    Token::Type::OperatorSlash,
-    Token::Type::OperatorStar,
-    Token::Type::OperatorPercent,
-    Token::Type::OperatorAND,
-    Token::Type::OperatorOR,
-    Token::Type::OperatorNOT,
-    Token::Type::ComparatorEquals,
-    Token::Type::ComparatorNotEquals,
-    Token::Type::ComparatorGreaterEqual,
-    Token::Type::ComparatorGreaterThan,
-    Token::Type::ComparatorLessEqual,
-    Token::Type::ComparatorLessThan
-}};
-
-Parser::OperatorArity Parser::getOperatorArity(std::vector<Token>::const_iterator &it, const std::vector<Token>::const_iterator &start)
+Ptr<Expression> Parser::parseExpression(TokenCursor& cursor, Arena& arena, Token::Type terminationToken)
 {
-    if(!operators.contains(it->type)) throw std::invalid_argument("Given token is not an operator and has no arity");
-
-    if(it == start) return OperatorArity::Unary;
-    if(operators.contains((it-1)->type)) return OperatorArity::Unary;
-
-    return OperatorArity::Binary;
-}
\ No newline at end of file
+    auto expression = parseBinary(cursor, arena);
+    if(!cursor.atEnd() && cursor.get().type != terminationToken)
+    {
+        std::ostringstream oss;
+        oss << "Unexpected token: " << cursor.get();
+        throw std::runtime_error(oss.str());
+    }
+    return expression;
+}
@@ -2,19 +2,97 @@
 
 #include "AST.hpp"
 #include "Tokens.hpp"
+#include <cstddef>
+#include <deque>
 #include <vector>
 
 using namespace Tokenization;
 using namespace AST;
 
 namespace Parser {
-    std::vector<std::unique_ptr<Statement>> parseTokens(const std::vector<Token>& tokens, std::vector<Token>::const_iterator& it);
-    std::unique_ptr<Expression> parseExpression(const std::vector<Token>& tokens, std::vector<Token>::const_iterator& it, Token::Type terminationToken = Token::Type::ParenthesisRight);
+    /**
+     *  The parser's position in a sequence of tokens, which it reads strictly forward.
+     *  Tokens come in windows [current, end) that refill() replaces once they are used up, so the
+     *  tokens may still be produced while they are parsed; get() is only valid until the cursor moves.
+     */
+    class TokenCursor {
+    public:
+        virtual ~TokenCursor() = default;
 
-    enum class OperatorArity {
-        Unary,
-        Binary
+        bool atEnd() { return current == end && !refill(); }
+        const Token& get() const { return *current; }
+        void advance()
+        {
+            if(atEnd()) return;
+            previous = *current;
+            ++current;
+        }
+
+        // The last token advanced over, reported by errors at the end of the tokens
+        const Token& getPrevious() const { return previous; }
+
+        // The current token at an address that lives as long as the tokens, for the AST to refer to
+        virtual const Token& keep() = 0;
+
+        /**
+         *  Statement bodies, blocks, parentheses and unary operators nested deeper than the limit are a
+         *  parse error. The parser keeps its nesting on the heap, so the limit bounds memory, not the stack.
+         */
+        void setNestingLimit(std::size_t limit) { nestingLimit = limit; }
+        // Throws at the current token past the limit; every enterNesting of a successful parse is left again
+        void enterNesting();
+        void leaveNesting() { --nesting; }
+
+        static constexpr std::size_t defaultNestingLimit = 1 << 20;
+
+    protected:
+        const Token* current = nullptr;
+        const Token* end = nullptr;
+        Token previous{};
+
+        std::size_t nesting = 0;
+        std::size_t nestingLimit = defaultNestingLimit;
+
+        // Moves the window to the next tokens, returns false if there are none
+        virtual bool refill() = 0;
+    };
+
+    class VectorCursor : public TokenCursor {
+    public:
+        explicit VectorCursor(const std::vector<Token>& tokens);
+
+        std::size_t getPosition() const;
+        const Token& keep() override;
+
+    protected:
+        bool refill() override;
+
+    private:
+        const Token* first;
+    };
+
+    // Reads a TokenStream; tokens kept for the AST are copied into kept, as the stream reuses its memory
+    class StreamCursor : public TokenCursor {
+    public:
+        StreamCursor(TokenStream& stream, std::deque<Token>& kept);
+        ~StreamCursor();
+
+        const Token& keep() override;
+
+    protected:
+        bool refill() override;
+
+    private:
+        TokenStream& stream;
+        std::deque<Token>& kept;
+        std::size_t windowSize = 0;
     };
 
-    OperatorArity getOperatorArity(std::vector<Token>::const_iterator& it, const std::vector<Token>::const_iterator& start);
-};
\ No newline at end of file
+    // Nodes are allocated in arena. A statement leaves the cursor at its last token, a code block stops at its closing '}'
+    Ptr<Statement> parseStatement(TokenCursor& cursor, Arena& arena);
+    std::vector<Ptr<Statement>> parseTokens(TokenCursor& cursor, Arena& arena);
+    // One statement of parseTokens at a time: moves past it, nullptr where parseTokens stops
+    Ptr<Statement> parseNextStatement(TokenCursor& cursor, Arena& arena);
+    // Leaves the cursor at terminationToken
+    Ptr<Expression> parseExpression(TokenCursor& cursor, Arena& arena, Token::Type terminationToken = Token::Type::ParenthesisRight);
+};
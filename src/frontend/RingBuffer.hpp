@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <stdexcept>
+
+/**
+ *  Bounded lock-free queue between one producer and one consumer thread.
+ *
+ *  The producer fills a run of free slots and publishes it, the consumer reads a run of elements
+ *  and releases it, so each side touches the other's index once per run rather than per element.
+ *  A side that has to wait sleeps on the other side's index with std::atomic::wait. Either side
+ *  can stop the exchange: close() after the last element, cancel() when no more are wanted.
+ */
+template<class T>
+class RingBuffer {
+public:
+    // capacity must be a power of two; maxRun bounds the runs handed to the producer, so that
+    // the consumer sees elements before the whole buffer fills
+    explicit RingBuffer(std::size_t capacity, std::size_t maxRun = 4096)
+        : elements(std::make_unique<T[]>(capacity)), capacity(capacity), maxRun(maxRun)
+    {
+        if(capacity == 0 || (capacity & (capacity - 1)) != 0) throw std::invalid_argument("Ring buffer capacity must be a power of two");
+    }
+
+    // Producer: free slots at the write position, empty once the consumer cancelled
+    std::span<T> reserve()
+    {
+        auto position = written.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            auto released = read.load(std::memory_order_acquire);
+            if(released & stoppedBit) return {};
+
+            auto free = capacity - (position - released);
+            if(free > 0)
+            {
+                auto index = position & (capacity - 1);
+                return {elements.get() + index, std::min({free, capacity - index, maxRun})};
+            }
+            read.wait(released, std::memory_order_acquire);
+        }
+    }
+
+    void publish(std::size_t count)
+    {
+        written.fetch_add(count, std::memory_order_release);
+        written.notify_one();
+    }
+
+    void close()
+    {
+        written.fetch_or(stoppedBit, std::memory_order_release);
+        written.notify_one();
+    }
+
+    // Consumer: published elements at the read position, empty once the producer closed and all were read
+    std::span<const T> acquire()
+    {
+        auto position = read.load(std::memory_order_relaxed) & ~stoppedBit;
+        for(;;)
+        {
+            auto published = written.load(std::memory_order_acquire);
+            auto available = (published & ~stoppedBit) - position;
+            if(available > 0)
+            {
+                auto index = position & (capacity - 1);
+                return {elements.get() + index, std::min(available, capacity - index)};
+            }
+            if(published & stoppedBit) return {};
+            written.wait(published, std::memory_order_acquire);
+        }
+    }
+
+    void release(std::size_t count)
+    {
+        if(count == 0) return;
+        read.fetch_add(count, std::memory_order_release);
+        read.notify_one();
+    }
+
+    void cancel()
+    {
+        read.fetch_or(stoppedBit, std::memory_order_release);
+        read.notify_one();
+    }
+
+private:
+    static constexpr std::size_t stoppedBit = std::size_t(1) << (sizeof(std::size_t) * 8 - 1);
+
+    std::unique_ptr<T[]> elements;
+    const std::size_t capacity;
+    const std::size_t maxRun;
+
+    // counts of elements ever published and released, plus stoppedBit once that side stopped
+    alignas(64) std::atomic<std::size_t> written{0};
+    alignas(64) std::atomic<std::size_t> read{0};
+};
@@ -0,0 +1,191 @@
+#include "Scanner.hpp"
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LING_SCANNER_X86_64
+#endif
+
+namespace {
+    constexpr bool isWhitespace(unsigned char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+    constexpr bool isDigit(unsigned char c) { return c >= '0' && c <= '9'; }
+    constexpr bool isIdentifierCharacter(unsigned char c) { return isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+
+    // Bit 0 whitespace, bit 1 digit, bit 2 identifier character
+    constexpr auto classes = [] {
+        std::array<uint8_t, 256> table{};
+        for(unsigned c = 0; c < 256; ++c)
+            table[c] = isWhitespace(c) | isDigit(c) << 1 | isIdentifierCharacter(c) << 2;
+        return table;
+    }();
+
+    void classifyScalar(const char* block, Scanner::Masks& masks)
+    {
+        masks = {};
+        for(unsigned i = 0; i < 64; ++i)
+        {
+            uint64_t bits = classes[static_cast<unsigned char>(block[i])];
+            masks.whitespace |= (bits & 1) << i;
+            masks.digits |= (bits >> 1 & 1) << i;
+            masks.identifier |= (bits >> 2 & 1) << i;
+        }
+    }
+
+    std::size_t countNewLinesScalar(const char* it, const char* end)
+    {
+        return std::count(it, end, '\n');
+    }
+
+#ifdef LING_SCANNER_X86_64
+    /**
+     *  The vector tests return 0xff in the bytes of a class and rely on unsigned range checks:
+     *  a byte is in [low, high] exactly when min(byte - low, high - low) == byte - low.
+     */
+    inline __m128i inRange(__m128i bytes, char low, char high)
+    {
+        auto shifted = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+        return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(high - low)), shifted);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i inRange(__m256i bytes, char low, char high)
+    {
+        auto shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8(low));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(high - low)), shifted);
+    }
+
+    void classifySSE2(const char* block, Scanner::Masks& masks)
+    {
+        masks = {};
+        for(unsigned i = 0; i < 64; i += 16)
+        {
+            auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+            auto whitespace = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), inRange(bytes, '\t', '\r'));
+            auto digits = inRange(bytes, '0', '9');
+            auto letters = inRange(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z');
+            auto identifier = _mm_or_si128(_mm_or_si128(letters, digits), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')));
+
+            masks.whitespace |= static_cast<uint64_t>(_mm_movemask_epi8(whitespace)) << i;
+            masks.digits |= static_cast<uint64_t>(_mm_movemask_epi8(digits)) << i;
+            masks.identifier |= static_cast<uint64_t>(_mm_movemask_epi8(identifier)) << i;
+        }
+    }
+
+    __attribute__((target("avx2"))) void classifyAVX2(const char* block, Scanner::Masks& masks)
+    {
+        masks = {};
+        for(unsigned i = 0; i < 64; i += 32)
+        {
+            auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+            auto whitespace = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), inRange(bytes, '\t', '\r'));
+            auto digits = inRange(bytes, '0', '9');
+            auto letters = inRange(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 'z');
+            auto identifier = _mm256_or_si256(_mm256_or_si256(letters, digits), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')));
+
+            masks.whitespace |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(whitespace))) << i;
+            masks.digits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(digits))) << i;
+            masks.identifier |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(identifier))) << i;
+        }
+    }
+
+    // Matches are subtracted from per-byte counters, which are summed before they can overflow
+    std::size_t countNewLinesSSE2(const char* it, const char* end)
+    {
+        std::size_t count = 0;
+        auto newLine = _mm_set1_epi8('\n');
+        while(end - it >= 16)
+        {
+            auto counters = _mm_setzero_si128();
+            for(int i = 0; i < 255 && end - it >= 16; ++i, it += 16)
+                counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(it)), newLine));
+
+            auto sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+            count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+        }
+        return count + countNewLinesScalar(it, end);
+    }
+
+    __attribute__((target("avx2"))) std::size_t countNewLinesAVX2(const char* it, const char* end)
+    {
+        std::size_t count = 0;
+        auto newLine = _mm256_set1_epi8('\n');
+        while(end - it >= 32)
+        {
+            auto counters = _mm256_setzero_si256();
+            for(int i = 0; i < 255 && end - it >= 32; ++i, it += 32)
+                counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(it)), newLine));
+
+            auto sums = _mm256_sad_epu8(counters, _mm256_setzero_si256());
+            auto halves = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+            count += _mm_cvtsi128_si32(halves) + _mm_extract_epi16(halves, 4);
+        }
+        return count + countNewLinesSSE2(it, end);
+    }
+#endif
+
+    const Scanner::Kernels scalarKernels = {classifyScalar, countNewLinesScalar};
+#ifdef LING_SCANNER_X86_64
+    const Scanner::Kernels sse2Kernels = {classifySSE2, countNewLinesSSE2};
+    const Scanner::Kernels avx2Kernels = {classifyAVX2, countNewLinesAVX2};
+#endif
+}
+
+Scanner::Level Scanner::getSupportedLevel()
+{
+#ifdef LING_SCANNER_X86_64
+    // SSE2 is part of x86-64; __builtin_cpu_supports reads cpuid and checks that the OS saves the AVX state
+    static const Level level = __builtin_cpu_supports("avx2") ? Level::AVX2 : Level::SSE2;
+    return level;
+#else
+    return Level::Scalar;
+#endif
+}
+
+const char* Scanner::getLevelName(Level level)
+{
+    switch(level)
+    {
+        case Level::Scalar: return "scalar";
+        case Level::SSE2: return "sse2";
+        case Level::AVX2: return "avx2";
+    }
+    throw std::invalid_argument("Invalid scanner level");
+}
+
+const Scanner::Kernels& Scanner::getKernels(Level level)
+{
+    if(level > getSupportedLevel()) throw std::invalid_argument(std::string("Scanner level ") + getLevelName(level) + " not supported by this CPU");
+
+    switch(level)
+    {
+        case Level::Scalar: return scalarKernels;
+#ifdef LING_SCANNER_X86_64
+        case Level::SSE2: return sse2Kernels;
+        case Level::AVX2: return avx2Kernels;
+#endif
+        default: throw std::invalid_argument("Invalid scanner level");
+    }
+}
+
+const Scanner::Kernels& Scanner::getKernels()
+{
+    static const Kernels& kernels = getKernels(getSupportedLevel());
+    return kernels;
+}
+
+void Scanner::Cursor::load(const char* it)
+{
+    blockBegin = it;
+    if(end - it >= 64)
+    {
+        kernels.classify(it, masks);
+        return;
+    }
+
+    // '\0' belongs to no class, so runs stop at the end of the buffer
+    char padded[64] = {};
+    std::memcpy(padded, it, end - it);
+    kernels.classify(padded, masks);
+}
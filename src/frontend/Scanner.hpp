@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ *  Character class kernels of the tokenizer.
+ *
+ *  Tokens are a few bytes long, so instead of testing every run separately the source is
+ *  classified 64 bytes at a time into bit masks, and a Cursor finds the end of each run with a
+ *  shift and a count of trailing zeros. The SSE2 and AVX2 kernels classify 16 and 32 bytes per
+ *  step; the best one the CPU supports is picked once through cpuid. All levels give the same
+ *  masks, the scalar one is kept for other CPUs and as the reference for bench/lexer.cpp.
+ */
+namespace Scanner {
+    enum class Level {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    // Bit i describes byte i of a 64-byte block
+    struct Masks {
+        // ' ', '\t', '\n', '\v', '\f' and '\r', as std::isspace in the "C" locale
+        uint64_t whitespace;
+        uint64_t digits;
+        // letters, digits and '_'
+        uint64_t identifier;
+    };
+
+    struct Kernels {
+        void (*classify)(const char* block, Masks& masks);
+        std::size_t (*countNewLines)(const char* it, const char* end);
+    };
+
+    Level getSupportedLevel();
+    const char* getLevelName(Level level);
+
+    // Kernels of the given level, which must be supported by the CPU
+    const Kernels& getKernels(Level level);
+    // Kernels of the best supported level
+    const Kernels& getKernels();
+
+    /**
+     *  Finds the ends of runs in a buffer scanned front to back. Each skip returns the end of the
+     *  run of its class starting at it (it itself when it does not start one), at most end.
+     */
+    class Cursor {
+    public:
+        explicit Cursor(const char* end, const Kernels& kernels = getKernels()) : kernels(kernels), end(end), blockBegin(end) {}
+
+        const char* skipWhitespace(const char* it) { return skip(it, &Masks::whitespace); }
+        const char* skipDigits(const char* it) { return skip(it, &Masks::digits); }
+        const char* skipIdentifier(const char* it) { return skip(it, &Masks::identifier); }
+
+    private:
+        const Kernels& kernels;
+        const char* end;
+        const char* blockBegin;
+        Masks masks;
+
+        void load(const char* it);
+
+        const char* skip(const char* it, uint64_t Masks::* run)
+        {
+            while(it < end)
+            {
+                if(it < blockBegin || it - blockBegin >= 64) load(it);
+
+                uint64_t outside = ~(masks.*run) >> (it - blockBegin);
+                if(outside) return std::min(it + std::countr_zero(outside), end);
+                it = blockBegin + 64;
+            }
+            return end;
+        }
+    };
+};
@@ -1,154 +1,494 @@
 #include "Tokens.hpp"
+#include "Interner.hpp"
+#include "Scanner.hpp"
 #include <stdexcept>
 #include <cctype>
-#include <unordered_map>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <mutex>
 #include <optional>
-#include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 
 using namespace Tokenization;
 
-std::unordered_map<std::string, Token::Type> types = {{
-    {"=", Token::Type::OperatorAssign},
-    {"+", Token::Type::OperatorPlus},
-    {"-", Token::Type::OperatorMinus},
-    {"*", Token::Type::OperatorStar},
-    {"/", Token::Type::OperatorSlash},
-    {"%", Token::Type::OperatorPercent},
-    {"(", Token::Type::ParenthesisLeft},
-    {")", Token::Type::ParenthesisRight},
+/**
+ *  Operators are matched by a small DFA unrolled into a switch: the first character selects the
+ *  state and only '=', '!', '<' and '>' may continue with a '='. Words are always scanned in full
+ *  and then classified against a perfect hash of the keywords, so "iffy" or "order" stay identifiers.
+ */
+struct OperatorMatch {
+    Token::Type type;
+    unsigned length;
+};
+
+static constexpr std::optional<OperatorMatch> matchOperator(std::string_view rest)
+{
+    bool equalsFollows = rest.size() > 1 && rest[1] == '=';
+
+    switch(rest.front())
+    {
+        case '+': return OperatorMatch{Token::Type::OperatorPlus, 1};
+        case '-': return OperatorMatch{Token::Type::OperatorMinus, 1};
+        case '*': return OperatorMatch{Token::Type::OperatorStar, 1};
+        case '/': return OperatorMatch{Token::Type::OperatorSlash, 1};
+        case '%': return OperatorMatch{Token::Type::OperatorPercent, 1};
+        case '(': return OperatorMatch{Token::Type::ParenthesisLeft, 1};
+        case ')': return OperatorMatch{Token::Type::ParenthesisRight, 1};
+        case '{': return OperatorMatch{Token::Type::BraceLeft, 1};
+        case '}': return OperatorMatch{Token::Type::BraceRight, 1};
+        case ';': return OperatorMatch{Token::Type::EndOfLine, 1};
+        case '=': return equalsFollows ? OperatorMatch{Token::Type::ComparatorEquals, 2} : OperatorMatch{Token::Type::OperatorAssign, 1};
+        case '<': return equalsFollows ? OperatorMatch{Token::Type::ComparatorLessEqual, 2} : OperatorMatch{Token::Type::ComparatorLessThan, 1};
+        case '>': return equalsFollows ? OperatorMatch{Token::Type::ComparatorGreaterEqual, 2} : OperatorMatch{Token::Type::ComparatorGreaterThan, 1};
+        case '!': if(equalsFollows) return OperatorMatch{Token::Type::ComparatorNotEquals, 2}; break;
+    }
+
+    return std::nullopt;
+}
+
+static_assert(matchOperator("==")->type == Token::Type::ComparatorEquals && matchOperator("==")->length == 2);
+static_assert(matchOperator("=1")->type == Token::Type::OperatorAssign && matchOperator("=1")->length == 1);
+static_assert(matchOperator(">=")->length == 2 && matchOperator("<")->length == 1);
+static_assert(!matchOperator("!") && !matchOperator("a"));
+
+struct Keyword {
+    std::string_view spelling;
+    Token::Type type = Token::Type::Identificator;
+};
+
+static constexpr Keyword keywords[] = {
     {"if", Token::Type::KeywordIf},
     {"let", Token::Type::KeywordLet},
     {"while", Token::Type::KeywordWhile},
     {"display", Token::Type::KeywordDisplay},
-    {";", Token::Type::EndOfLine},
-    {"{", Token::Type::BraceLeft},
-    {"}", Token::Type::BraceRight},
     {"and", Token::Type::OperatorAND},
     {"or", Token::Type::OperatorOR},
-    {"not", Token::Type::OperatorNOT},
-    {"==", Token::Type::ComparatorEquals},
-    {"!=", Token::Type::ComparatorNotEquals},
-    {">", Token::Type::ComparatorGreaterThan},
-    {">=", Token::Type::ComparatorGreaterEqual},
-    {"<", Token::Type::ComparatorLessThan},
-    {"<=", Token::Type::ComparatorLessEqual}
-}};
-
-static bool matchKeyword(const char* it, const char* end, const std::string& key) {
-    for(auto c : key) {
-        if(it == end || *it != c) return false;
-        ++it;
-    }
-    return true;
+    {"not", Token::Type::OperatorNOT}
+};
+
+static constexpr std::size_t keywordHash(std::string_view word)
+{
+    return (static_cast<unsigned char>(word.front()) + static_cast<unsigned char>(word.back())) % 16;
 }
 
-static std::optional<Token::Type> matchLongestTokenType(const char* &it, const char* end) {
-    struct Match {
-        Token::Type type;
-        size_t length;
+static constexpr auto keywordTable = [] {
+    std::array<Keyword, 16> table{};
+    for(auto& keyword : keywords) table[keywordHash(keyword.spelling)] = keyword;
+    return table;
+}();
 
-        Match(Token::Type type, size_t length) : type(type), length(length) {}
-    };
+static_assert([] {
+    for(auto& keyword : keywords)
+        if(keywordTable[keywordHash(keyword.spelling)].spelling != keyword.spelling) return false;
+    return true;
+}(), "keywordHash must stay collision free when keywords are added");
 
-    std::optional<Match> best;
+static constexpr std::optional<Token::Type> matchKeyword(std::string_view word)
+{
+    auto& slot = keywordTable[keywordHash(word)];
+    if(slot.spelling == word) return slot.type;
+    return std::nullopt;
+}
 
-    for(const auto& [key, type] : types) {
-        if(matchKeyword(it, end, key)) {
-            if(!best.has_value() || key.size() > best->length) {
-                best = Match(type, key.size());
-            }
+static_assert(matchKeyword("while") == Token::Type::KeywordWhile && matchKeyword("or") == Token::Type::OperatorOR);
+static_assert(!matchKeyword("iffy") && !matchKeyword("letter") && !matchKeyword("order") && !matchKeyword("x"));
+
+// Indexed by Token::sourceId; a slot is only written by the owner of its registration, but a
+// tokenizer thread may extend a view that the parser reads at the same time
+struct RegisteredSource {
+    std::atomic<const char*> data{nullptr};
+    std::atomic<std::size_t> size{0};
+};
+static std::array<RegisteredSource, 1 << 16> registeredSources;
+static std::mutex registryMutex;
+static std::vector<uint16_t> freeSourceIds;
+static std::size_t nextSourceId = 0;
+
+Tokenization::Source::Source(std::string_view text)
+{
+    {
+        std::lock_guard lock(registryMutex);
+        if(!freeSourceIds.empty())
+        {
+            id = freeSourceIds.back();
+            freeSourceIds.pop_back();
         }
+        else if(nextSourceId < registeredSources.size()) id = nextSourceId++;
+        else throw std::runtime_error("Too many sources open at once");
     }
+    update(text);
+}
 
-    if(!best.has_value()) return std::optional<Token::Type>();
-    
-    it += best->length;
-    return best->type;
+Tokenization::Source::~Source()
+{
+    update({});
+    std::lock_guard lock(registryMutex);
+    freeSourceIds.push_back(id);
 }
 
-std::vector<Token> Tokenization::tokenize(std::string_view source)
+uint16_t Tokenization::Source::getId() const
 {
-    std::vector<Token> out;
-    auto sourceEnd = source.end();
+    return id;
+}
+
+std::string_view Tokenization::Source::getText() const
+{
+    return getText(id);
+}
 
-    unsigned lineCount = 1;
-    unsigned charsCountAtLineStart = 0;
+void Tokenization::Source::update(std::string_view text)
+{
+    if(text.size() > std::numeric_limits<uint32_t>::max()) throw std::runtime_error("Source larger than 4 GiB");
+    registeredSources[id].data.store(text.data(), std::memory_order_release);
+    registeredSources[id].size.store(text.size(), std::memory_order_release);
+}
 
-    for(auto it = source.begin(); it != sourceEnd; ++it) {
-        if(*it == '\n') {
-            lineCount++;
-            charsCountAtLineStart = (it - source.begin());
-            continue;
-        }
+std::string_view Tokenization::Source::getText(uint16_t id)
+{
+    auto& source = registeredSources[id];
+    return {source.data.load(std::memory_order_acquire), source.size.load(std::memory_order_acquire)};
+}
 
-        unsigned position = (it - source.begin() - charsCountAtLineStart);
-        std::ostringstream errorLineOss;
+static unsigned getLine(std::string_view source, std::size_t offset)
+{
+    return Scanner::getKernels().countNewLines(source.data(), source.data() + offset) + 1;
+}
 
-        auto previousNewLine = it;
-        auto begin = source.begin();
-        while(previousNewLine != begin)
+// Positions count from the newline before the line, so they start at 1 on every line but the first
+static unsigned getPosition(std::string_view source, std::size_t offset)
+{
+    auto previousNewLine = offset == 0 ? std::string_view::npos : source.rfind('\n', offset - 1);
+    return previousNewLine == std::string_view::npos ? offset : offset - previousNewLine;
+}
+
+static std::string getErrorLine(std::string_view source, std::size_t offset)
+{
+    auto previousNewLine = offset == 0 ? std::string_view::npos : source.rfind('\n', offset - 1);
+    auto lineBegin = previousNewLine == std::string_view::npos ? 0 : previousNewLine + 1;
+    auto lineEnd = std::min(source.find('\n', offset), source.size());
+
+    std::string errorLine;
+    errorLine.append(source.substr(lineBegin, offset - lineBegin));
+    errorLine.append("\033[31m").append(1, source[offset]).append("\033[0m");
+    if(offset + 1 < lineEnd) errorLine.append(source.substr(offset + 1, lineEnd - offset - 1));
+    errorLine.append("\n");
+    errorLine.append(offset - lineBegin, ' ').append("\033[31m~\033[0m");
+    return errorLine;
+}
+
+static Token makeToken(Token::Type type, const Source& source, std::size_t offset, std::size_t length, uint32_t symbol = 0)
+{
+    if(length > std::numeric_limits<uint16_t>::max())
+    {
+        std::ostringstream oss;
+        oss << "Token longer than " << std::numeric_limits<uint16_t>::max() << " characters at line " << getLine(source.getText(), offset)
+            << ", position " << getPosition(source.getText(), offset) << ":\n" << getErrorLine(source.getText(), offset);
+        throw std::runtime_error(oss.str());
+    }
+    return Token{static_cast<uint32_t>(offset), symbol, static_cast<uint16_t>(length), source.getId(), type};
+}
+
+/**
+ *  Identificators repeat a lot, so a tokenization interns each spelling once instead of taking
+ *  the shared interner's lock for every token, which would serialize parallel tokenization.
+ *  Open addressing keeps a hit to one probe in most cases; slots view the interner's copy of the
+ *  spelling, so they outlive the source buffer.
+ */
+class SymbolCache {
+public:
+    uint32_t intern(std::string_view spelling)
+    {
+        uint32_t hash = 2166136261u;
+        for(unsigned char c : spelling) hash = (hash ^ c) * 16777619u;
+
+        for(std::size_t i = hash & (slots.size() - 1);; i = (i + 1) & (slots.size() - 1))
         {
-            --previousNewLine;
-            if(*previousNewLine == '\n')
-                break;
+            auto& slot = slots[i];
+            if(slot.symbol == 0)
+            {
+                auto symbol = Interner::intern(spelling);
+                slot = {Interner::getSpelling(symbol), hash, symbol};
+                if(++used * 2 > slots.size()) grow();
+                return symbol;
+            }
+            if(slot.hash == hash && slot.spelling == spelling) return slot.symbol;
         }
-        auto lineBegin = *previousNewLine == '\n' ? previousNewLine+1 : previousNewLine;
-        auto lineEnd = it;
-        auto end = source.end();
-        while(lineEnd != end)
+    }
+
+private:
+    // symbol 0 is the empty spelling, which is never looked up, so it marks free slots
+    struct Slot {
+        std::string_view spelling;
+        uint32_t hash = 0;
+        uint32_t symbol = 0;
+    };
+
+    std::vector<Slot> slots = std::vector<Slot>(256);
+    std::size_t used = 0;
+
+    void grow()
+    {
+        std::vector<Slot> previous(slots.size() * 2);
+        previous.swap(slots);
+        for(auto& slot : previous)
         {
-            if(*lineEnd == '\n')
-                break;
-            ++lineEnd;
+            if(slot.symbol == 0) continue;
+            auto i = slot.hash & (slots.size() - 1);
+            while(slots[i].symbol != 0) i = (i + 1) & (slots.size() - 1);
+            slots[i] = slot;
         }
-        if(lineBegin < it) errorLineOss << std::string(lineBegin, it);
-        errorLineOss << "\033[31m" << *it << "\033[0m";
-        if(it + 1 < lineEnd) errorLineOss << std::string(it + 1, lineEnd);
-        errorLineOss << "\n";
-        errorLineOss << std::string(it - lineBegin, ' ') << "\033[31m~\033[0m";
+    }
+};
+
+// Appends the tokens of source[begin, end) to out; returns false if a '\0' ended the program early
+template<class Output>
+static bool tokenizeInto(Output& out, SymbolCache& symbols, const Source& registeredSource, std::size_t begin, std::size_t end)
+{
+    auto source = registeredSource.getText();
+    const char* sourceEnd = source.data() + std::min(end, source.size());
+    const char* it = source.data() + begin;
+    Scanner::Cursor scanner(sourceEnd);
 
-        if(std::isspace(*it)) continue;
-        if(*it == '\0') break;
+    while((it = scanner.skipWhitespace(it)) != sourceEnd) {
+        if(*it == '\0') return false;
 
-        if(std::isdigit(*it)) {
-            auto start = it;
-            while(it != sourceEnd && std::isdigit(*it)) ++it;
-            auto end = it--;
+        std::size_t offset = it - source.data();
 
-            out.emplace_back(Token::Type::Literal, lineCount, position, errorLineOss.str(), std::string(start, end));
+        if(std::isdigit(*it)) {
+            auto literalEnd = scanner.skipDigits(it);
+            out.push_back(makeToken(Token::Type::Literal, registeredSource, offset, literalEnd - it));
+            it = literalEnd;
             continue;
         }
 
-        auto tokenType = matchLongestTokenType(it, source.end());
-        if(tokenType) {
-            --it;
-            out.emplace_back(*tokenType, lineCount, position, errorLineOss.str());
+        if(auto match = matchOperator(std::string_view(it, sourceEnd - it))) {
+            out.push_back(makeToken(match->type, registeredSource, offset, match->length));
+            it += match->length;
             continue;
         }
 
         if(std::isalpha(*it)) {
-            auto start = it;
-            while(it != sourceEnd && (std::isalnum(*it) || *it == '_')) ++it;
-            auto end = it--;
-
-            out.emplace_back(Token::Type::Identificator, lineCount, position, errorLineOss.str(), std::string(start, end));
+            std::string_view word(it, scanner.skipIdentifier(it) - it);
+            if(auto keyword = matchKeyword(word)) out.push_back(makeToken(*keyword, registeredSource, offset, word.size()));
+            else out.push_back(makeToken(Token::Type::Identificator, registeredSource, offset, word.size(), symbols.intern(word)));
+            it += word.size();
             continue;
         }
 
         std::ostringstream oss;
-        oss << "Could not tokenize character " << *it << " at line " << lineCount << ", position " << position << ":\n" << errorLineOss.str();
+        oss << "Could not tokenize character " << *it << " at line " << getLine(source, offset) << ", position " << getPosition(source, offset) << ":\n" << getErrorLine(source, offset);
 
         throw std::runtime_error(oss.str());
     }
+    return true;
+}
+
+std::vector<Token> Tokenization::tokenize(const Source& source, std::size_t begin, std::size_t end)
+{
+    std::vector<Token> out;
+    SymbolCache symbols;
+    tokenizeInto(out, symbols, source, begin, end);
+    return out;
+}
+
+std::vector<Token> Tokenization::tokenizeParallel(const Source& source, unsigned threads)
+{
+    static constexpr std::size_t minimumChunk = 1 << 20;
+
+    auto text = source.getText();
+    std::size_t chunksCount = std::clamp<std::size_t>(text.size() / minimumChunk, 1, std::max(threads, 1u));
+    if(chunksCount == 1) return tokenize(source);
+
+    // chunk i is text[bounds[i], bounds[i + 1]), every chunk but the last ends after a newline
+    std::vector<std::size_t> bounds{0};
+    for(std::size_t i = 1; i < chunksCount; ++i)
+    {
+        auto newLine = text.find('\n', std::max(bounds.back(), text.size() * i / chunksCount));
+        if(newLine == std::string_view::npos) break;
+        bounds.push_back(newLine + 1);
+    }
+    bounds.push_back(text.size());
+    chunksCount = bounds.size() - 1;
+
+    struct Chunk {
+        std::vector<Token> tokens;
+        bool complete = true;
+        std::exception_ptr error;
+    };
+    std::vector<Chunk> chunks(chunksCount);
+
+    auto tokenizeChunk = [&](std::size_t i)
+    {
+        try
+        {
+            SymbolCache symbols;
+            chunks[i].tokens.reserve((bounds[i + 1] - bounds[i]) / 8);
+            chunks[i].complete = tokenizeInto(chunks[i].tokens, symbols, source, bounds[i], bounds[i + 1]);
+        }
+        catch(...)
+        {
+            chunks[i].error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(std::size_t i = 1; i < chunksCount; ++i) workers.emplace_back(tokenizeChunk, i);
+    tokenizeChunk(0);
+    for(auto& worker : workers) worker.join();
+
+    // as in a sequential run, the first error or '\0' decides where the program ends
+    std::size_t used = 0;
+    while(used < chunksCount)
+    {
+        if(chunks[used].error) std::rethrow_exception(chunks[used].error);
+        if(!chunks[used++].complete) break;
+    }
+
+    // a prefix sum of the token counts places every chunk in the result, copied by its own thread
+    std::vector<std::size_t> starts{0};
+    for(std::size_t i = 0; i < used; ++i) starts.push_back(starts.back() + chunks[i].tokens.size());
+
+    auto out = std::move(chunks[0].tokens);
+    out.resize(starts.back());
+
+    workers.clear();
+    for(std::size_t i = 1; i < used; ++i)
+        workers.emplace_back([&, i] { std::copy(chunks[i].tokens.begin(), chunks[i].tokens.end(), out.begin() + starts[i]); });
+    for(auto& worker : workers) worker.join();
     return out;
 }
 
+// Tokenizes the complete lines of every chunk before the next one is read, see tokenize(ChunkedInput&, ...)
+template<class Output>
+static void tokenizeChunks(Output& out, ChunkedInput& input, Source& source)
+{
+    SymbolCache symbols;
+    for(std::size_t tokenized = 0, previousSize = 0;;)
+    {
+        bool more = input.readChunk();
+        auto text = input.getText();
+        source.update(text);
+
+        auto end = text.size();
+        if(more)
+        {
+            // only the new chunk is searched, a single huge line must not be rescanned for every chunk
+            auto lastNewLine = text.substr(previousSize).rfind('\n');
+            end = lastNewLine == std::string_view::npos ? tokenized : previousSize + lastNewLine + 1;
+        }
+        previousSize = text.size();
+
+        if(end > tokenized)
+        {
+            if(!tokenizeInto(out, symbols, source, tokenized, end)) break;
+            tokenized = end;
+        }
+        if(!more) break;
+    }
+}
+
+std::vector<Token> Tokenization::tokenize(ChunkedInput& input, Source& source, unsigned threads)
+{
+    // the whole input is available at once, as with a mapped file
+    if(threads > 1 && !input.readChunk())
+    {
+        source.update(input.getText());
+        return tokenizeParallel(source, threads);
+    }
+
+    std::vector<Token> out;
+    tokenizeChunks(out, input, source);
+    return out;
+}
+
+// Writes tokens into the ring buffer in runs; once the consumer cancelled they are checked but dropped
+class RingOutput {
+public:
+    explicit RingOutput(RingBuffer<Token>& buffer) : buffer(buffer) {}
+
+    void push_back(const Token& token)
+    {
+        if(filled == run.size() && !nextRun()) return;
+        run[filled++] = token;
+    }
+
+    void flush()
+    {
+        if(filled > 0) buffer.publish(filled);
+        filled = 0;
+    }
+
+private:
+    RingBuffer<Token>& buffer;
+    std::span<Token> run;
+    std::size_t filled = 0;
+    bool cancelled = false;
+
+    bool nextRun()
+    {
+        flush();
+        if(cancelled) return false;
+        run = buffer.reserve();
+        cancelled = run.empty();
+        return !cancelled;
+    }
+};
+
+Tokenization::TokenStream::TokenStream(ChunkedInput& input, Source& source, std::size_t capacity) : buffer(capacity)
+{
+    producer = std::thread([this, &input, &source] {
+        RingOutput out(buffer);
+        try
+        {
+            tokenizeChunks(out, input, source);
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+        out.flush();
+        buffer.close();
+    });
+}
+
+Tokenization::TokenStream::~TokenStream()
+{
+    if(!producer.joinable()) return;
+    buffer.cancel();
+    producer.join();
+}
+
+std::span<const Token> Tokenization::TokenStream::acquire()
+{
+    return buffer.acquire();
+}
+
+void Tokenization::TokenStream::release(std::size_t count)
+{
+    buffer.release(count);
+}
+
+void Tokenization::TokenStream::finish()
+{
+    if(producer.joinable())
+    {
+        buffer.cancel();
+        producer.join();
+    }
+    if(error) std::rethrow_exception(std::exchange(error, nullptr));
+}
+
 std::ostream &Tokenization::operator<<(std::ostream &os, const Token &token)
 {
     os << token.type;
-    if(token.type == Token::Type::Identificator || token.type == Token::Type::Literal) os << token.value << '\'';
-    return os << " in line " << token.line << ", position " << token.position << "\n" << token.errorLine; 
+    if(token.type == Token::Type::Identificator || token.type == Token::Type::Literal) os << token.getText() << '\'';
+    return os << " in line " << token.getLine() << ", position " << token.getPosition() << "\n" << token.getErrorLine();
 }
 
 std::ostream &Tokenization::operator<<(std::ostream &os, const Token::Type &type)
@@ -243,12 +583,22 @@ std::ostream &Tokenization::operator<<(std::ostream &os, const Token::Type &type
     return os;
 }
 
-Tokenization::Token::Token(Type type, unsigned line, unsigned position, std::string errorLine, const std::string &value) 
-    : type(type), value(value), line(line), position(position), errorLine(errorLine)
+std::string_view Tokenization::Token::getText() const
 {
-    if(value.empty() && (type == Token::Type::Identificator || type == Token::Type::Literal))
-    {
-        std::cerr << "Token type: " << type << "\nValue: " << value << "\n";
-        throw std::invalid_argument("Cannot create empty token of provided type");
-    }
-}
\ No newline at end of file
+    return Source::getText(sourceId).substr(offset, length);
+}
+
+unsigned Tokenization::Token::getLine() const
+{
+    return ::getLine(Source::getText(sourceId), offset);
+}
+
+unsigned Tokenization::Token::getPosition() const
+{
+    return ::getPosition(Source::getText(sourceId), offset);
+}
+
+std::string Tokenization::Token::getErrorLine() const
+{
+    return ::getErrorLine(Source::getText(sourceId), offset);
+}
@@ -1,12 +1,41 @@
 #pragma once
 
+#include "RingBuffer.hpp"
+#include <cstdint>
+#include <exception>
+#include <span>
 #include <string>
+#include <thread>
+#include <string_view>
 #include <vector>
 #include <ostream>
 
 namespace Tokenization {
+    /**
+     *  Registers a source buffer under a 16-bit id, so that tokens can refer to it without a pointer.
+     *  The buffer must outlive the registration; its owner calls update() when the buffer moves.
+     */
+    class Source {
+    public:
+        explicit Source(std::string_view text);
+        ~Source();
+
+        Source(const Source&) = delete;
+        Source& operator=(const Source&) = delete;
+
+        uint16_t getId() const;
+        std::string_view getText() const;
+        void update(std::string_view text);
+
+        static std::string_view getText(uint16_t id);
+
+    private:
+        uint16_t id;
+    };
+
+    // 16 bytes with no owned memory: the spelling is read back from the registered source
     struct Token {
-        enum class Type {
+        enum class Type : uint8_t {
             Literal,
             Identificator,
             OperatorPlus,
@@ -33,18 +62,85 @@ namespace Tokenization {
             EndOfLine,
             BraceLeft,
             BraceRight
-        } type;
+        };
 
-        std::string value;
+        // of the first character in the whole registered buffer
+        uint32_t offset;
+        // interned spelling of identificators, 0 for other tokens
+        uint32_t symbol;
+        uint16_t length;
+        uint16_t sourceId;
+        Type type;
 
-        unsigned line;
-        unsigned position;
-        std::string errorLine;
+        std::string_view getText() const;
 
-        Token(Type type, unsigned lineCount, unsigned position, std::string errorLine, const std::string& value = "");
+        // Line, column and highlighted source line are only needed for diagnostics, so they are rebuilt on demand
+        unsigned getLine() const;
+        unsigned getPosition() const;
+        std::string getErrorLine() const;
     };
+    static_assert(sizeof(Token) <= 16);
+
+    /**
+     *  Tokenizes source[begin, end), which must start at the beginning of a line.
+     *  The compile server uses the range to re-tokenize the lines of edited statements.
+     */
+    std::vector<Token> tokenize(const Source& source, std::size_t begin = 0, std::size_t end = std::string_view::npos);
+
+    /**
+     *  Parallel mode for large sources: no token spans lines, so the source is split at newlines
+     *  into up to threads chunks of at least 1 MiB, tokenized concurrently and concatenated.
+     *  Gives the same tokens and errors as the sequential tokenize.
+     */
+    std::vector<Token> tokenizeParallel(const Source& source, unsigned threads);
+
+    // Input that arrives in chunks, kept in one buffer; a TokenStream needs a buffer that does not move as it grows
+    class ChunkedInput {
+    public:
+        virtual ~ChunkedInput() = default;
 
-    std::vector<Token> tokenize(std::string_view source);
+        // Appends the next chunk to the text, returns false once the input is exhausted
+        virtual bool readChunk() = 0;
+        virtual std::string_view getText() const = 0;
+    };
+
+    /**
+     *  Tokenizes the input while it is read: tokens never span lines, so the complete lines of
+     *  every chunk are tokenized before the next one is read. source is kept registered to the
+     *  input's text, which tokens refer to by offset. Input that is complete from the start, such
+     *  as a mapped file, is tokenized on up to threads threads.
+     */
+    std::vector<Token> tokenize(ChunkedInput& input, Source& source, unsigned threads = 1);
+
+    /**
+     *  Streaming mode: a producer thread tokenizes the input chunk by chunk, as tokenize does, into a
+     *  bounded ring buffer that the consumer reads concurrently, so the memory held by tokens depends
+     *  on the capacity rather than on the input size.
+     */
+    class TokenStream {
+    public:
+        TokenStream(ChunkedInput& input, Source& source, std::size_t capacity = 1 << 16);
+        ~TokenStream();
+
+        TokenStream(const TokenStream&) = delete;
+        TokenStream& operator=(const TokenStream&) = delete;
+
+        // Waits for the next tokens; empty once the input is exhausted or tokenization stopped
+        std::span<const Token> acquire();
+        // The first count acquired tokens are no longer used
+        void release(std::size_t count);
+
+        /**
+         *  Stops consuming and rethrows the tokenization error, if any. The producer still checks the
+         *  rest of the input, so errors are reported as if the whole input was tokenized first.
+         */
+        void finish();
+
+    private:
+        RingBuffer<Token> buffer;
+        std::exception_ptr error;
+        std::thread producer;
+    };
 
     std::ostream& operator<<(std::ostream& os, const Token& token);
     std::ostream& operator<<(std::ostream& os, const Token::Type& type);